@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "memory.h"
+#include "pagetable.h"
+#include "cache.h"
+#include "trace.h"
+#include "output.h"
+#include "pipeline.h"
+
+// Measures how fast cachesimplus runs, one stage at a time and end to end.
+// Usage: bench <page table> <trace> [kB ways block]
+// The cache defaults to 32kB, 8-way, 64B blocks with LRU replacement.
+//
+// The trace is taken a chunk at a time. Each chunk is parsed into a
+// buffer, translated, run through the cache and formatted (to /dev/null),
+// with a clock around every stage, so each stage's cost is measured on
+// its own. The whole trace is then run again as cachesimplus runs it,
+// sequentially and with --pipeline. Every row gives accesses per second
+// and nanoseconds per access.
+
+#define BENCH_CHUNK (1 << 20)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char* stage, long accesses, double seconds) {
+    double rate = seconds > 0.0 ? accesses / seconds : 0.0;
+    double ns = accesses > 0 ? seconds * 1e9 / accesses : 0.0;
+    printf("%-12s %12ld %10.3f %14.0f %10.2f\n", stage, accesses, seconds, rate, ns);
+}
+
+// A fresh memory and cache, so every run starts cold
+static cache* reset_cache(const cache_config* config, cache* old) {
+    destroy_cache(old);
+    destroy_memory();
+    init_memory();
+    return create_cache(config, 1);
+}
+
+// The per-access loop of cachesimplus, without statistics
+static void run_sequential(trace_reader* trace, const page_table* pt, cache* c, output_writer* out) {
+    const trace_record* rec;
+    int status;
+    while ((status = next_record(trace, &rec)) != 0) {
+        if (status < 0) {
+            continue;
+        }
+        int pa = translate_address(pt, trace_vaddr(rec));
+        if (pa == PAGEFAULT_ADDR) {
+            write_pagefault(out);
+            continue;
+        }
+        if (rec->op == TRACE_LOAD) {
+            unsigned char val[rec->size];
+            int hit = cache_load(c, pa, rec->size, val);
+            write_load(out, trace_vaddr(rec), hit, val, rec->size);
+        }
+        else {
+            int hit = cache_store(c, pa, rec->size, rec->data);
+            write_store(out, trace_vaddr(rec), hit);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 && argc != 6) {
+        printf("%s: Wrong number of arguments, expecting 2 or 5\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    cache_config config = {.size_kb = 32, .assoc = 8, .block_size = 64, .policy = REPL_LRU};
+    if (argc == 6) {
+        config.size_kb = atoi(argv[3]);
+        config.assoc = atoi(argv[4]);
+        config.block_size = atoi(argv[5]);
+    }
+    page_table* pt = load_page_table(argv[1]);
+    if (pt == NULL) {
+        printf("%s: Could not read page table %s\n", argv[0], argv[1]);
+        return EXIT_FAILURE;
+    }
+    trace_reader* trace = open_trace(argv[2]);
+    if (trace == NULL) {
+        printf("%s: Could not read trace %s\n", argv[0], argv[2]);
+        return EXIT_FAILURE;
+    }
+    init_memory();
+    cache* c = reset_cache(&config, NULL);
+    if (c == NULL) {
+        printf("%s: Bad cache geometry\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int devNull = open("/dev/null", O_WRONLY);
+    output_writer* out = create_writer(devNull);
+
+    trace_record* recs = (trace_record*) malloc(BENCH_CHUNK * sizeof(trace_record));
+    int* pas = (int*) malloc(BENCH_CHUNK * sizeof(int));
+    unsigned char* hits = (unsigned char*) malloc(BENCH_CHUNK);
+    double parseTime = 0, translateTime = 0, cacheTime = 0, outputTime = 0;
+    long records = 0, mapped = 0;
+    int status = 1;
+    while (status != 0) {
+        double t0 = now();
+        long n = 0;
+        const trace_record* rec;
+        while (n < BENCH_CHUNK && (status = next_record(trace, &rec)) != 0) {
+            if (status > 0) recs[n++] = *rec;
+        }
+        double t1 = now();
+        for (long i = 0; i < n; i++) {
+            pas[i] = translate_address(pt, trace_vaddr(&recs[i]));
+        }
+        double t2 = now();
+        for (long i = 0; i < n; i++) {
+            if (pas[i] == PAGEFAULT_ADDR) {
+                continue;
+            }
+            unsigned char val[256];
+            hits[i] = (recs[i].op == TRACE_LOAD) ? cache_load(c, pas[i], recs[i].size, val)
+                : cache_store(c, pas[i], recs[i].size, recs[i].data);
+            mapped++;
+        }
+        double t3 = now();
+        for (long i = 0; i < n; i++) {
+            if (pas[i] == PAGEFAULT_ADDR) {
+                write_pagefault(out);
+            }
+            else if (recs[i].op == TRACE_LOAD) {
+                // the bytes don't matter here, only the formatting work
+                write_load(out, trace_vaddr(&recs[i]), hits[i], recs[i].data, recs[i].size);
+            }
+            else {
+                write_store(out, trace_vaddr(&recs[i]), hits[i]);
+            }
+        }
+        flush_writer(out);
+        double t4 = now();
+        parseTime += t1 - t0;
+        translateTime += t2 - t1;
+        cacheTime += t3 - t2;
+        outputTime += t4 - t3;
+        records += n;
+    }
+
+    printf("%s: %ld records, %dkB %d-way %dB blocks lru, %.2f%% hits\n", argv[2], records,
+        config.size_kb, config.assoc, config.block_size,
+        c->hits + c->misses ? 100.0 * c->hits / (c->hits + c->misses) : 0.0);
+    printf("%-12s %12s %10s %14s %10s\n", "stage", "accesses", "seconds", "accesses/s", "ns/access");
+    report("parse", records, parseTime);
+    report("translate", records, translateTime);
+    report("cache", mapped, cacheTime);
+    report("output", records, outputTime);
+
+    rewind_trace(trace);
+    c = reset_cache(&config, c);
+    double t0 = now();
+    run_sequential(trace, pt, c, out);
+    flush_writer(out);
+    report("end-to-end", records, now() - t0);
+
+    rewind_trace(trace);
+    c = reset_cache(&config, c);
+    t0 = now();
+    if (run_pipeline(trace, argv[2], pt, NULL, c, NULL, out) == 0) {
+        flush_writer(out);
+        report("pipeline", records, now() - t0);
+    }
+
+    destroy_writer(out);
+    close(devNull);
+    free(recs);
+    free(pas);
+    free(hits);
+    destroy_cache(c);
+    close_trace(trace);
+    destroy_page_table(pt);
+    destroy_memory();
+    return EXIT_SUCCESS;
+}
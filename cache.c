@@ -0,0 +1,646 @@
+/**
+ * cache.c - Set-associative cache engine for cachesimplus
+ * Tag store kept as flat arrays indexed by set * assoc + way, block data
+ * in a single slab. Victims come from a pluggable replacement policy.
+ *
+ * Stores are write-back or write-through, write-allocate or not, and
+ * memory writes can go through a coalescing write buffer. Every byte read
+ * from or written to memory is counted so the policies can be compared.
+ * A prefetcher can fill lines ahead of demand or serve misses from its
+ * stream buffers; its reads are counted separately.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "cache.h"
+#include "memory.h"
+
+// Definitions ================================================================
+static cache_kernel select_kernel(const cache* c);
+
+/**
+ * Creates an empty cache for "cfg"; the block size may be any power of two.
+ * A cache made without data only tracks tags, dirty bits and replacement
+ * state, for cache_access(), and has no write buffer or prefetcher.
+ * Returns NULL on a bad geometry or a policy that can't handle it.
+ */
+cache* create_cache(const cache_config* cfg, int with_data) {
+	int size_kb = cfg->size_kb, assoc = cfg->assoc, block_size = cfg->block_size;
+	// addresses are split into tag/index/offset with masks
+	if (size_kb < 1 || assoc < 1 || block_size < 1 || (block_size & (block_size - 1)) != 0) {
+		return NULL;
+	}
+
+	cache* c = (cache*) malloc(sizeof(cache));
+	c->size_kb = size_kb;
+	c->assoc = assoc;
+	c->block_size = block_size;
+
+	c->nsets = (size_kb * 1024) / block_size / assoc;
+	if (c->nsets < 1) c->nsets = 1;
+
+	int m = c->nsets;
+	int q = 0;
+	while (m >>= 1) q++;
+	c->ibits = q;
+
+	int n = block_size;
+	int r = 0;
+	while (n >>= 1) r++;
+	c->bbits = r;
+
+	int lines = c->nsets * assoc;
+	c->tags = (int*) malloc(lines * sizeof(int));
+	for (int i = 0; i < lines; i++) {
+		c->tags[i] = INVALID_TAG;
+	}
+	c->dirty = (unsigned char*) calloc(lines, sizeof(unsigned char));
+	c->valid_ways = (int*) calloc(c->nsets, sizeof(int));
+	c->repl = create_repl(cfg->policy, c->nsets, assoc, cfg->seed);
+	c->data = NULL;
+	c->write_through = cfg->write_through;
+	c->no_write_allocate = cfg->no_write_allocate;
+	c->wbuf = NULL;
+	c->pf = NULL;
+	c->prefetched = NULL;
+	if (with_data) {
+		c->data = (unsigned char*) calloc((size_t) lines * block_size, sizeof(unsigned char));
+		if (cfg->write_buffer > 0) {
+			c->wbuf = create_write_buffer(cfg->write_buffer, block_size);
+		}
+		c->pf = create_prefetcher(cfg->prefetch, cfg->prefetch_degree, block_size);
+		if (c->pf != NULL) {
+			c->prefetched = (unsigned char*) calloc(lines, sizeof(unsigned char));
+		}
+	}
+	c->hits = 0;
+	c->misses = 0;
+	c->writebacks = 0;
+	c->evictions = 0;
+	c->store_bytes = 0;
+	c->read_bytes = 0;
+	c->written_bytes = 0;
+	c->memory_writes = 0;
+	if (c->repl == NULL) {
+		destroy_cache(c);
+		return NULL;
+	}
+	c->kernel = select_kernel(c);
+	return c;
+}
+
+void destroy_cache(cache* c) {
+	if (c == NULL) {
+		return;
+	}
+	free(c->tags);
+	free(c->dirty);
+	free(c->valid_ways);
+	destroy_repl(c->repl);
+	free(c->data);
+	destroy_write_buffer(c->wbuf);
+	destroy_prefetcher(c->pf);
+	free(c->prefetched);
+	free(c);
+}
+
+/**
+ * Returns the way in the set starting at "base" holding "tag", or -1.
+ * Wide sets are compared eight ways at a time so the compare vectorizes;
+ * empty ways hold INVALID_TAG and never match.
+ */
+static int find_way(const cache* c, int base, int tag) {
+	const int* tags = c->tags + base;
+	int w = 0;
+	for (; w + 8 <= c->assoc; w += 8) {
+		int any = 0;
+		for (int k = 0; k < 8; k++) {
+			any |= (tags[w + k] == tag);
+		}
+		if (any) break;
+	}
+	for (; w < c->assoc; w++) {
+		if (tags[w] == tag) {
+			return w;
+		}
+	}
+	return -1;
+}
+
+// Fills empty ways lowest first, then asks the replacement policy
+static int find_victim(cache* c, int set) {
+	if (c->valid_ways[set] < c->assoc) {
+		c->valid_ways[set]++;
+		return find_way(c, set * c->assoc, INVALID_TAG);
+	}
+	return repl_victim(c->repl, set);
+}
+
+// Physical address of the first byte of "line" in "set"
+static int line_address(const cache* c, int set, int line) {
+	return (int) (((unsigned int) c->tags[line] << (c->bbits + c->ibits))
+		| ((unsigned int) set << c->bbits));
+}
+
+/**
+ * Puts "tag" in way "way" of "set" with a clean line. If the block leaving
+ * was dirty, its address goes in "victim" and 1 is returned so the caller
+ * can write it back; the writeback is counted here. "line" gets
+ * set * assoc + way.
+ */
+static int install_line(cache* c, int set, int way, int tag, int* line, int* victim) {
+	int l = set * c->assoc + way;
+	int was_dirty = c->dirty[l];
+	if (c->tags[l] != INVALID_TAG) {
+		c->evictions++;
+	}
+	if (c->prefetched != NULL && c->prefetched[l]) {
+		c->pf->unused++;
+		c->prefetched[l] = 0;
+	}
+	if (was_dirty) {
+		*victim = line_address(c, set, l);
+		c->writebacks++;
+	}
+	c->tags[l] = tag;
+	c->dirty[l] = 0;
+	repl_fill(c->repl, set, way);
+	*line = l;
+	return was_dirty;
+}
+
+// Claims a victim way in "set" for "tag", as install_line()
+static int allocate_line(cache* c, int set, int tag, int* line, int* victim) {
+	return install_line(c, set, find_victim(c, set), tag, line, victim);
+}
+
+// Tag-only access to the one block holding "address"
+static int access_block(cache* c, int address, int is_store) {
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	int base = set * c->assoc;
+	int way = find_way(c, base, tag);
+	int hit = (way >= 0);
+	int line = base + way;
+	if (hit) {
+		repl_hit(c->repl, set, way);
+		c->hits++;
+	}
+	else {
+		c->misses++;
+		if (is_store && c->no_write_allocate) {
+			repl_skip(c->repl);
+			return 0;
+		}
+		int victim;
+		allocate_line(c, set, tag, &line, &victim);
+	}
+	if (is_store && !c->write_through) {
+		c->dirty[line] = 1;
+	}
+	return hit;
+}
+
+/**
+ * Tag-only lookup that leaves a miss alone: a hit updates replacement
+ * state (and the dirty bit for a store), and either way the hit or miss is
+ * counted. The caller decides whether and when to cache_fill().
+ * Returns 1 on a hit, 0 on a miss.
+ */
+int cache_lookup(cache* c, int address, int is_store) {
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	int way = find_way(c, set * c->assoc, tag);
+	if (way < 0) {
+		c->misses++;
+		return 0;
+	}
+	repl_hit(c->repl, set, way);
+	if (is_store) {
+		c->dirty[set * c->assoc + way] = 1;
+	}
+	c->hits++;
+	return 1;
+}
+
+/**
+ * Tag-only insert of the block holding "address", which must not already
+ * be cached, with the given dirty bit. If a block had to make room, its
+ * address goes in "victim". Counts the eviction in c->evictions, and
+ * leaves hits, misses and writebacks to the caller.
+ * Returns -1 if nothing was evicted, else the victim's dirty bit.
+ */
+int cache_fill(cache* c, int address, int dirty, int* victim) {
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	int way = find_victim(c, set);
+	int line = set * c->assoc + way;
+	int evicted = -1;
+	if (c->tags[line] != INVALID_TAG) {
+		c->evictions++;
+		evicted = c->dirty[line];
+		*victim = line_address(c, set, line);
+	}
+	c->tags[line] = tag;
+	c->dirty[line] = (unsigned char) dirty;
+	repl_fill(c->repl, set, way);
+	return evicted;
+}
+
+/**
+ * Drops the block holding "address" without writing it anywhere.
+ * Returns -1 if it wasn't cached, else its dirty bit.
+ */
+int cache_invalidate(cache* c, int address) {
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	int way = find_way(c, set * c->assoc, tag);
+	if (way < 0) {
+		return -1;
+	}
+	int line = set * c->assoc + way;
+	int dirty = c->dirty[line];
+	c->tags[line] = INVALID_TAG;
+	c->dirty[line] = 0;
+	c->valid_ways[set]--;
+	return dirty;
+}
+
+/**
+ * Marks the block holding "address" dirty without touching replacement
+ * state, as for a write-back arriving from the level above.
+ * Returns 1 if the block was cached, 0 if not.
+ */
+int cache_mark_dirty(cache* c, int address) {
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	int way = find_way(c, set * c->assoc, tag);
+	if (way < 0) {
+		return 0;
+	}
+	c->dirty[set * c->assoc + way] = 1;
+	return 1;
+}
+
+/**
+ * Returns the line (set * assoc + way) holding the block with "address",
+ * or -1 if it isn't cached, so callers can keep per-line state of their
+ * own. Touches nothing.
+ */
+int cache_find_line(const cache* c, int address) {
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	int way = find_way(c, set * c->assoc, tag);
+	return (way < 0) ? -1 : set * c->assoc + way;
+}
+
+// Memory reads for a fill, seeing anything still in the write buffer
+static void memory_read(cache* c, unsigned char* buf, int address, int size) {
+	read_from_memory(buf, address, size);
+	c->read_bytes += size;
+	if (c->wbuf != NULL) {
+		write_buffer_forward(c->wbuf, address, buf, size);
+	}
+}
+
+// Memory writes, through the write buffer if there is one
+static void memory_write(cache* c, const unsigned char* buf, int address, int size) {
+	if (c->pf != NULL) {
+		stream_invalidate(c->pf, address, size);
+	}
+	if (c->wbuf != NULL) {
+		write_buffer_put(c->wbuf, address, buf, size);
+		return;
+	}
+	write_to_memory((unsigned char*) buf, address, size);
+	c->written_bytes += size;
+	c->memory_writes++;
+}
+
+/**
+ * Brings the block holding "address" into a line of "set", writing back
+ * the dirty block it replaces first. The block comes from a stream buffer
+ * if one holds it, else from memory. Returns the line.
+ */
+static int fill_line(cache* c, int set, int tag, int address) {
+	int line, victim;
+	if (allocate_line(c, set, tag, &line, &victim)) {
+		memory_write(c, c->data + (size_t) line * c->block_size, victim, c->block_size);
+	}
+	int start = address & ~(c->block_size - 1);
+	unsigned char* block = c->data + (size_t) line * c->block_size;
+	if (c->pf == NULL || c->pf->kind != PF_STREAM || !stream_take(c->pf, start, block, c->wbuf)) {
+		memory_read(c, block, start, c->block_size);
+	}
+	return line;
+}
+
+/**
+ * Looks up the block holding "address" for a demand access and counts the
+ * hit or miss. A hit on a prefetched line credits the prefetcher and, like
+ * a miss, sets "trigger". Returns the line, or -1 on a miss.
+ */
+static int demand_lookup(cache* c, int set, int tag, int* trigger) {
+	int base = set * c->assoc;
+	int way = find_way(c, base, tag);
+	if (way < 0) {
+		c->misses++;
+		*trigger = 1;
+		return -1;
+	}
+	repl_hit(c->repl, set, way);
+	c->hits++;
+	int line = base + way;
+	*trigger = 0;
+	if (c->prefetched != NULL && c->prefetched[line]) {
+		c->prefetched[line] = 0;
+		c->pf->useful++;
+		*trigger = 1;
+	}
+	return line;
+}
+
+/**
+ * Trains the prefetcher on a demand access and fills the lines it asks
+ * for that aren't cached yet.
+ */
+static void run_prefetcher(cache* c, int address, int trigger) {
+	if (c->pf == NULL || c->pf->kind == PF_STREAM) {
+		return;
+	}
+	int blocks[PF_MAX_DEGREE];
+	int n = prefetch_suggest(c->pf, address, trigger, blocks);
+	for (int k = 0; k < n; k++) {
+		int set = (blocks[k] >> c->bbits) & ((1 << c->ibits) - 1);
+		int tag = blocks[k] >> (c->bbits + c->ibits);
+		if (find_way(c, set * c->assoc, tag) >= 0) {
+			c->pf->redundant++;
+			continue;
+		}
+		int line, victim;
+		if (allocate_line(c, set, tag, &line, &victim)) {
+			memory_write(c, c->data + (size_t) line * c->block_size, victim, c->block_size);
+		}
+		unsigned char* block = c->data + (size_t) line * c->block_size;
+		read_from_memory(block, blocks[k], c->block_size);
+		if (c->wbuf != NULL) {
+			write_buffer_forward(c->wbuf, blocks[k], block, c->block_size);
+		}
+		c->prefetched[line] = 1;
+		c->pf->issued++;
+	}
+}
+
+// Loads "size" bytes, all within the block holding "address"
+static int load_block(cache* c, int address, int size, unsigned char* out) {
+	int blockoff = address & ((1 << c->bbits) - 1);
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	int trigger;
+	int line = demand_lookup(c, set, tag, &trigger);
+	int hit = (line >= 0);
+	if (!hit) {
+		line = fill_line(c, set, tag, address);
+	}
+
+	memcpy(out, c->data + (size_t) line * c->block_size + blockoff, size);
+	run_prefetcher(c, address, trigger);
+	return hit;
+}
+
+// Stores "size" bytes, all within the block holding "address". A store
+// miss fetches the rest of the line unless the cache doesn't allocate on
+// writes, in which case the bytes go straight to memory.
+static int store_block(cache* c, int address, int size, const unsigned char* val) {
+	int blockoff = address & ((1 << c->bbits) - 1);
+	int set = (address >> c->bbits) & ((1 << c->ibits) - 1);
+	int tag = address >> (c->bbits + c->ibits);
+	c->store_bytes += size;
+	int trigger;
+	int line = demand_lookup(c, set, tag, &trigger);
+	int hit = (line >= 0);
+	if (!hit) {
+		if (c->no_write_allocate) {
+			repl_skip(c->repl);
+			memory_write(c, val, address, size);
+			run_prefetcher(c, address, trigger);
+			return 0;
+		}
+		line = fill_line(c, set, tag, address);
+	}
+
+	memcpy(c->data + (size_t) line * c->block_size + blockoff, val, size);
+	if (c->write_through) {
+		memory_write(c, val, address, size);
+	}
+	else {
+		c->dirty[line] = 1;
+	}
+	run_prefetcher(c, address, trigger);
+	return hit;
+}
+
+// Bytes of an access at "address" that fall in its first block
+static int block_part(const cache* c, int address, int size) {
+	int rest = c->block_size - (address & (c->block_size - 1));
+	return (size < rest) ? size : rest;
+}
+
+// Tag-only access for any geometry, a block at a time
+static int generic_access(cache* c, int address, int size, int is_store) {
+	int hit = 1;
+	do {
+		int n = block_part(c, address, size);
+		hit &= access_block(c, address, is_store);
+		address += n;
+		size -= n;
+	} while (size > 0);
+	return hit;
+}
+
+/**
+ * generic_access() with the associativity and log2 of the block size fixed
+ * at compile time, so the offset shift is a constant and the way loops
+ * unroll into straight-line compares. Only the set count stays a runtime
+ * value. Counts and replacement calls match access_block() exactly.
+ */
+#define CACHE_KERNEL(WAYS, BBITS) \
+static int access_w##WAYS##_b##BBITS(cache* c, int address, int size, int is_store) { \
+	unsigned int first = (unsigned int) address >> (BBITS); \
+	unsigned int last = ((unsigned int) address + size - 1) >> (BBITS); \
+	unsigned int set_mask = (1u << c->ibits) - 1; \
+	int hit = 1; \
+	for (unsigned int b = first; ; b++) { \
+		int set = (int) (b & set_mask); \
+		int tag = (int) (b >> c->ibits); \
+		const int* tags = c->tags + set * (WAYS); \
+		int way = -1; \
+		for (int w = 0; w < (WAYS); w++) { \
+			if (tags[w] == tag) way = w; \
+		} \
+		if (way >= 0) { \
+			repl_hit(c->repl, set, way); \
+			c->hits++; \
+		} \
+		else { \
+			c->misses++; \
+			hit = 0; \
+			if (!is_store || !c->no_write_allocate) { \
+				if (c->valid_ways[set] < (WAYS)) { \
+					c->valid_ways[set]++; \
+					for (int w = (WAYS) - 1; w >= 0; w--) { \
+						if (tags[w] == INVALID_TAG) way = w; \
+					} \
+				} \
+				else { \
+					way = repl_victim(c->repl, set); \
+				} \
+				int line, victim; \
+				install_line(c, set, way, tag, &line, &victim); \
+			} \
+			else { \
+				repl_skip(c->repl); \
+			} \
+		} \
+		if (way >= 0 && is_store && !c->write_through) { \
+			c->dirty[set * (WAYS) + way] = 1; \
+		} \
+		if (b == last) break; \
+	} \
+	return hit; \
+}
+
+// One kernel per common geometry: 1 to 16 ways, 32 to 128-byte blocks
+CACHE_KERNEL(1, 5) CACHE_KERNEL(1, 6) CACHE_KERNEL(1, 7)
+CACHE_KERNEL(2, 5) CACHE_KERNEL(2, 6) CACHE_KERNEL(2, 7)
+CACHE_KERNEL(4, 5) CACHE_KERNEL(4, 6) CACHE_KERNEL(4, 7)
+CACHE_KERNEL(8, 5) CACHE_KERNEL(8, 6) CACHE_KERNEL(8, 7)
+CACHE_KERNEL(16, 5) CACHE_KERNEL(16, 6) CACHE_KERNEL(16, 7)
+
+#define KERNEL_MIN_BBITS 5
+#define KERNEL_BLOCK_SIZES 3
+
+static const cache_kernel kernels[][KERNEL_BLOCK_SIZES] = {
+	{ access_w1_b5, access_w1_b6, access_w1_b7 },
+	{ access_w2_b5, access_w2_b6, access_w2_b7 },
+	{ access_w4_b5, access_w4_b6, access_w4_b7 },
+	{ access_w8_b5, access_w8_b6, access_w8_b7 },
+	{ access_w16_b5, access_w16_b6, access_w16_b7 },
+};
+
+// The kernel for "c"'s geometry, or generic_access() for an unusual one
+static cache_kernel select_kernel(const cache* c) {
+	int row = -1;
+	switch (c->assoc) {
+	case 1: row = 0; break;
+	case 2: row = 1; break;
+	case 4: row = 2; break;
+	case 8: row = 3; break;
+	case 16: row = 4; break;
+	}
+	int col = c->bbits - KERNEL_MIN_BBITS;
+	if (row < 0 || col < 0 || col >= KERNEL_BLOCK_SIZES) {
+		return generic_access;
+	}
+	return kernels[row][col];
+}
+
+/**
+ * Tag-only access: updates tags, dirty bits, replacement state and counts
+ * exactly as cache_load()/cache_store() would, without moving any data.
+ * An access crossing block boundaries touches, and counts, each block.
+ * Runs the kernel create_cache() picked for the geometry.
+ * Returns 1 if every block hit, 0 otherwise.
+ */
+int cache_access(cache* c, int address, int size, int is_store) {
+	return c->kernel(c, address, size, is_store);
+}
+
+/**
+ * Loads "size" bytes at physical "address" into "out", a block at a time
+ * if the access crosses block boundaries (each block counts as a hit or
+ * miss of its own). Returns 1 if every block hit, 0 otherwise.
+ */
+int cache_load(cache* c, int address, int size, unsigned char* out) {
+	int hit = 1;
+	do {
+		int n = block_part(c, address, size);
+		hit &= load_block(c, address, n, out);
+		address += n;
+		out += n;
+		size -= n;
+	} while (size > 0);
+	return hit;
+}
+
+/**
+ * Stores "size" bytes from "val" at physical "address", split by block
+ * like cache_load(). Returns 1 if every block hit, 0 otherwise.
+ */
+int cache_store(cache* c, int address, int size, const unsigned char* val) {
+	int hit = 1;
+	do {
+		int n = block_part(c, address, size);
+		hit &= store_block(c, address, n, val);
+		address += n;
+		val += n;
+		size -= n;
+	} while (size > 0);
+	return hit;
+}
+
+/**
+ * Sends everything still in the write buffer to memory.
+ */
+void cache_drain(cache* c) {
+	if (c->wbuf != NULL) {
+		write_buffer_drain(c->wbuf);
+	}
+}
+
+/**
+ * Prints hit/miss totals and, for a cache holding data, memory traffic.
+ * Write traffic is also given against the bytes the trace stored, what
+ * a write-through cache without a buffer would send to memory.
+ */
+void print_cache_stats(const cache* c) {
+	long accesses = c->hits + c->misses;
+	double hit_rate = accesses ? 100.0 * c->hits / accesses : 0.0;
+	printf("Cache: %dkB, %d-way, %dB blocks, %s, %s, %s\n", c->size_kb, c->assoc, c->block_size,
+		repl_policy_name(c->repl->policy), c->write_through ? "write-through" : "write-back",
+		c->no_write_allocate ? "no-write-allocate" : "write-allocate");
+	printf("Cache hits: %ld misses: %ld hit rate: %.2f%%\n", c->hits, c->misses, hit_rate);
+	printf("Writebacks: %ld\n", c->writebacks);
+	if (c->data == NULL) {
+		return;
+	}
+
+	long written = c->written_bytes, writes = c->memory_writes;
+	if (c->wbuf != NULL) {
+		written += c->wbuf->bytes_out;
+		writes += c->wbuf->drains;
+	}
+	printf("Memory read: %ld bytes, written: %ld bytes in %ld writes\n", c->read_bytes, written, writes);
+	double ratio = c->store_bytes ? 100.0 * written / c->store_bytes : 0.0;
+	printf("Stored: %ld bytes, memory writes are %.2f%% of that (saved %ld bytes)\n",
+		c->store_bytes, ratio, c->store_bytes - written);
+	if (c->wbuf != NULL) {
+		const write_buffer* wb = c->wbuf;
+		printf("Write buffer: %d entries, %ld writes in, %ld coalesced, %ld writes out, saved %ld bytes\n",
+			wb->entries, wb->writes, wb->coalesced, wb->drains, wb->bytes_in - wb->bytes_out);
+	}
+	if (c->pf != NULL) {
+		// coverage: share of the misses that would have gone to memory
+		// that the prefetcher served instead
+		const prefetcher* p = c->pf;
+		long demand = c->read_bytes / c->block_size;
+		double accuracy = p->issued ? 100.0 * p->useful / p->issued : 0.0;
+		double coverage = (p->useful + demand) ? 100.0 * p->useful / (p->useful + demand) : 0.0;
+		printf("Prefetcher: %s, degree %d, issued %ld, useful %ld, unused %ld, redundant %ld\n",
+			prefetcher_name(p->kind), p->degree, p->issued, p->useful, p->unused, p->redundant);
+		printf("Prefetch accuracy: %.2f%% coverage: %.2f%% extra memory reads: %ld bytes\n",
+			accuracy, coverage, p->issued * c->block_size);
+	}
+}
+// ============================================================================
@@ -0,0 +1,77 @@
+/**
+ * cache.h - Set-associative cache engine for cachesimplus
+ * Tag store kept as flat arrays indexed by set * assoc + way, block data
+ * in a single slab. Victims come from a pluggable replacement policy.
+ **/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "replacement.h"
+#include "writebuf.h"
+#include "prefetch.h"
+
+#define INVALID_TAG (-1)
+
+typedef struct cache_config {
+	int size_kb;
+	int assoc;
+	int block_size;
+	int policy;           // REPL_*
+	unsigned int seed;    // for random and BRRIP replacement
+	int write_through;    // stores go straight to memory, lines stay clean
+	int no_write_allocate; // store misses go to memory without filling a line
+	int write_buffer;     // entries in a coalescing write buffer, 0 for none
+	int prefetch;         // PF_*
+	int prefetch_degree;
+} cache_config;
+
+typedef struct cache cache;
+
+// Tag-only access routine, specialized for the cache's geometry
+typedef int (*cache_kernel)(cache* c, int address, int size, int is_store);
+
+struct cache {
+	int size_kb;
+	int assoc;
+	int block_size;
+	int nsets;
+	int bbits;            // log2(block_size)
+	int ibits;            // log2(nsets)
+	int* tags;            // [nsets * assoc], INVALID_TAG for an empty way
+	unsigned char* dirty; // [nsets * assoc]
+	int* valid_ways;      // [nsets], ways in use, so full sets skip the empty-way scan
+	repl_state* repl;
+	unsigned char* data;  // [nsets * assoc * block_size], NULL for a tag-only cache
+	int write_through;
+	int no_write_allocate;
+	write_buffer* wbuf;   // NULL without a write buffer
+	prefetcher* pf;       // NULL without a prefetcher
+	unsigned char* prefetched; // [nsets * assoc], filled by the prefetcher and not used yet
+	long hits;
+	long misses;
+	long writebacks;
+	long evictions;       // valid blocks replaced, clean or dirty
+	long store_bytes;     // bytes stored by the trace
+	long read_bytes;      // bytes read from memory
+	long written_bytes;   // bytes written to memory, not counting the write buffer's
+	long memory_writes;   // calls to write_to_memory(), likewise
+	cache_kernel kernel;  // runs cache_access()
+};
+
+// Signatures =================================================================
+cache* create_cache(const cache_config* cfg, int with_data);
+void destroy_cache(cache* c);
+int cache_access(cache* c, int address, int size, int is_store);
+int cache_lookup(cache* c, int address, int is_store);
+int cache_fill(cache* c, int address, int dirty, int* victim);
+int cache_invalidate(cache* c, int address);
+int cache_mark_dirty(cache* c, int address);
+int cache_find_line(const cache* c, int address);
+int cache_load(cache* c, int address, int size, unsigned char* out);
+int cache_store(cache* c, int address, int size, const unsigned char* val);
+void cache_drain(cache* c);
+void print_cache_stats(const cache* c);
+// ============================================================================
+
+#endif
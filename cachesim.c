@@ -94,8 +94,7 @@ int main(int argc, char* argv[]) {
         // Read the address and access size info
         fscanf(myFile, "%x", &currAddress);
         fscanf(myFile, "%d", &accessSize);
-        unsigned char d_buff[64];
-        u_int8_t val_load[blockSize];
+        unsigned char d_buff[blockSize];
         set_node* actually_used;
 
         int blockoff = (currAddress >> 0) & ((1 << bbits) - 1);
@@ -235,7 +234,7 @@ int main(int argc, char* argv[]) {
 
         //STORE
         else {
-            unsigned char data_buffer[64], * pos = data_buffer;
+            unsigned char data_buffer[2 * accessSize + 1], * pos = data_buffer;
             fscanf(myFile, "%s", pos);
             unsigned char val[accessSize + 1];
             size_t count = 0;
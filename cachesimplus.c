@@ -1,394 +1,632 @@
+#define _POSIX_C_SOURCE 200809L
+
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 #include "memory.h"
-int virt2phys(int va, char* fileName);
+#include "pagetable.h"
+#include "tlb.h"
+#include "cache.h"
+#include "trace.h"
+#include "output.h"
+#include "sweep.h"
+#include "mrc.h"
+#include "hierarchy.h"
+#include "stats.h"
+#include "coherence.h"
+#include "pipeline.h"
+#include "timing.h"
+#include "checkpoint.h"
 
 int main(int argc, char* argv[]) {
     init_memory();
-    int cacheSize, associativity, blockSize, index;
-    FILE* f;
-   /* if (argc != 5) {
-        printf("%s: Wrong number of arguments, expecting 5\n", argv[0]);
+    int cacheSize, associativity, blockSize;
+    if (argc < 6) {
+        printf("%s: Wrong number of arguments, expecting at least 5\n", argv[0]);
         return EXIT_FAILURE;
-    }*/
-
-
-    typedef struct set_node {
-        struct set_node* more_recent;
-        unsigned char* data;
-        int tag;
-        int dirty;
-        int valid;
-        int lru;
-    } set_node;
-
-
-    // Buffer to store instruction (i.e. "load" or "store")
-    char instruction_buffer[6];
-
-
-    // Open the trace file in read mode
-    FILE* myFile = fopen(argv[2], "r");
-
-    // Read in the command line arguments
-    sscanf(argv[3], "%d", &cacheSize);
-    sscanf(argv[4], "%d", &associativity);
-    sscanf(argv[5], "%d", &blockSize);
-
-
-
-    int nsets = (cacheSize * 1024) / blockSize / associativity;
-    if (nsets < 1) nsets = 1;
-
-    int m = nsets;
-    int q = 0;
-    while (m >>= 1) q++;
-    int ibits = q;
-
-    int n = blockSize;
-    int r = 0;
-    while (n >>= 1) r++;
-    int bbits = r;
-
-    int tbits = 24 - ibits - bbits;
-
-
-
-    set_node* cache[nsets];
-
-
-    for (int i = 0; i < nsets; i++) {
-        cache[i] = (set_node*)malloc(sizeof(set_node));
-        set_node* head = cache[i];
-        head->valid = 0;
-        head->dirty = 0;
-        head->data = (unsigned char*)malloc(blockSize * sizeof(unsigned char));
-        head->lru = 0;
-        head->more_recent = NULL;
-        for (int j = 0; j < associativity - 1; j++) {
-            //printf("%d\n", j);
-            set_node* nset = (set_node*)malloc(sizeof(set_node));
-            nset->more_recent = NULL;
-            nset->valid = 0;
-            nset->lru = 0;
-            nset->dirty = 0;
-            nset->data = (unsigned char*)malloc(blockSize * sizeof(unsigned char));
-            head->more_recent = nset;
-            head = head->more_recent;
-        }
     }
 
 
-    //int tick = 0;
-    // Keep reading the instruction until end of file
-    int pointless = 0;
-    while (fscanf(myFile, "%s", &instruction_buffer) != EOF) {
-        //tick++;
-        int is_miss;
-        int currAddress, accessSize;
-        int other;
-        // Read the address and access size info
-        fscanf(myFile, "%x", &currAddress);
-        fscanf(myFile, "%d", &accessSize);
-        unsigned char d_buff[64];
-        u_int8_t val_load[blockSize];
-        set_node* actually_used;
-        other = currAddress;
-        currAddress = virt2phys(currAddress, argv[1]);
-        if (currAddress == NULL) {
-            printf("%s", "PAGEFAULT\n");
-            continue;
-        }
-        int blockoff = (currAddress >> 0) & ((1 << bbits) - 1);
-        int index = (currAddress >> bbits) & ((1 << ibits) - 1);
-        //int ctag = (currAddress >> tbits) & ((1 << tbits) - 1);
-        int ctag = (currAddress >> (bbits + ibits));
-        //printf("the index is: %d, the blockoff is: %d, the tag is: %d\n", index, blockoff, ctag);
-        set_node* lru_set = cache[index];
-        set_node* temp = lru_set;
-        unsigned char* target_block;
-        set_node* target_index;
-        int counter = 0;
-        unsigned char* cold_block;
-        set_node* cold_index;
+    // Load the page table once up front
+    page_table* ptable = load_page_table(argv[1]);
+    if (ptable == NULL) {
+        printf("%s: Could not read page table %s\n", argv[0], argv[1]);
+        return EXIT_FAILURE;
+    }
 
-        int hit = 0;
-        int comp = 0;
+    // Open the trace, text or binary
+    trace_reader* trace = open_trace(argv[2]);
+    if (trace == NULL) {
+        printf("%s: Could not read trace %s\n", argv[0], argv[2]);
+        return EXIT_FAILURE;
+    }
 
-        int max = temp->lru;
-        while (temp != NULL) {
-            if (temp->tag == ctag && temp->valid == 1) {
-                hit = 1;
-                break;
-            }
-            if (temp->tag == ctag && temp->valid == 0) {
-                comp = 1;
-                cold_block = temp->data;
-                cold_index = temp;
+    // Read in the command line arguments. Each one may also be a list,
+    // "8,16,32", or a power-of-two range, "1-64", which runs a sweep
+    int sizes[SWEEP_MAX_VALUES], assocs[SWEEP_MAX_VALUES], blocks[SWEEP_MAX_VALUES];
+    int numSizes = parse_value_list(argv[3], sizes, SWEEP_MAX_VALUES);
+    int numAssocs = parse_value_list(argv[4], assocs, SWEEP_MAX_VALUES);
+    int numBlocks = parse_value_list(argv[5], blocks, SWEEP_MAX_VALUES);
+    if (numSizes < 1 || numAssocs < 1 || numBlocks < 1) {
+        printf("%s: Bad cache geometry %s %s %s\n", argv[0], argv[3], argv[4], argv[5]);
+        return EXIT_FAILURE;
+    }
+    cacheSize = sizes[0];
+    associativity = assocs[0];
+    blockSize = blocks[0];
+
+    // Optional flags after the positional arguments
+    // --tlb <entries> <ways> <lru|random> : translate through a simulated TLB
+    // --walk-cache <entries> : page-walk cache for a radix page table's
+    //     walks on TLB misses, none by default
+    // --walk-refs : read the page-table entries each walk reads through
+    //     the data cache (or hierarchy), before the access that missed;
+    //     --stats counts them as loads
+    // --policy <lru|plru|fifo|random|srrip|brrip|opt> : cache replacement,
+    //     a comma separated list runs a sweep
+    // --seed <n> : seed for random and BRRIP replacement
+    // --write-through : stores also go to memory, lines never get dirty
+    // --no-write-allocate : store misses go to memory without a fill
+    // --write-buffer <n> : n-entry coalescing buffer in front of memory writes
+    // --prefetch <nextline|stride|stream> [degree] : prefetch lines ahead
+    //     into the cache, or through stream buffers "degree" blocks deep
+    // --stats : print the end-of-run report (hits, 3C misses, evictions,
+    //     writebacks, page faults, memory traffic)
+    // --stats-json : the same report as JSON, without per-access output
+    // --quiet : no per-access output, only the totals
+    // --sweep : one CSV row of totals per configuration instead of a trace
+    // --json : like --sweep, as JSON
+    // --mrc : fully-associative LRU miss-ratio curve for each block size,
+    //     from one stack-distance pass; size and ways are ignored
+    //     (sweeps and --mrc model write-back, write-allocate caches and
+    //     don't take write policy, --write-buffer, --prefetch, --stats or
+    //     --timing)
+    // --hierarchy <file> : run a multi-level hierarchy described in "file"
+    //     and print per-level totals; size, ways and block size are ignored
+    //     (levels are write-back and write-allocate with their own
+    //     policies; not with --policy, write policy, --write-buffer,
+    //     --prefetch or --stats)
+    // --sample <rate> : approximate a sweep or --mrc by simulating only a
+    //     hashed "rate" fraction of sets (sweep) or blocks (--mrc, SHARDS)
+    // --threads <n> : worker threads for a sweep, all cores by default
+    // --pipeline : parse, translate, simulate and format on a thread each
+    // --timing : time every access on an in-order core with non-blocking
+    //     caches and print cycles, AMAT and MSHR use (not with --stats-json)
+    // --latency <hit> <memory> : cycles for a cache hit and for memory
+    //     behind it, 4 and 100 by default; --hierarchy uses its own
+    // --mshrs <n> : misses in flight at once for --timing, 8 by default
+    // --cores <trace,...> : multi-core run, the trace argument is core 0's
+    //     and each trace listed adds a core with its own private cache
+    //     (write-back, write-allocate; not with --tlb, --stats, --timing or
+    //     prefetching)
+    // --protocol <mesi|moesi> : coherence protocol for --cores, MESI by default
+    // --interleave <rr|time> : take the cores' records round-robin or from
+    //     the core with the lowest simulated clock
+    // --checkpoint <file> <n> : save the whole run to "file" every n trace
+    //     records (0 for never, or e.g. 1e6) and where --stop-after ends it
+    // --restore <file> : carry on from a checkpoint, set up with the same
+    //     cache, TLB, --stats and --timing options as the run that saved it
+    // --stop-after <n> : end the run once n trace records have been read,
+    //     counting from the start of the trace
+    tlb* dtlb = NULL;
+    int policies[SWEEP_MAX_VALUES] = {REPL_LRU};
+    int numPolicies = 1;
+    int policy = REPL_LRU;
+    int policyGiven = 0;
+    unsigned int seed = 0;
+    int printStats = 0;
+    int statsJson = 0;
+    int writeThrough = 0;
+    int noWriteAllocate = 0;
+    int writeBuffer = 0;
+    int prefetch = PF_NONE;
+    int prefetchDegree = 0;
+    int quiet = 0;
+    int sweepMode = numSizes > 1 || numAssocs > 1 || numBlocks > 1;
+    int json = 0;
+    int mrcMode = 0;
+    double sampleRate = 1.0;
+    const char* hierarchyFile = NULL;
+    int pipelined = 0;
+    int walkEntries = 0;
+    int walkRefs = 0;
+    const char* checkpointFile = NULL;
+    long checkpointEvery = 0;
+    const char* restoreFile = NULL;
+    long stopAfter = -1;
+    int timed = 0;
+    int hitLatency = 4;
+    int memoryLatency = 100;
+    int numMshrs = 8;
+    char* coreTraces = NULL;
+    int protocol = COH_MESI;
+    int interleave = COH_ROUND_ROBIN;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (cores > 0) ? (int) cores : 1;
+    for (int i = 6; i < argc; i++) {
+        if (strcmp(argv[i], "--tlb") == 0 && i + 3 < argc) {
+            int tlbEntries = 0, tlbWays = 0;
+            int tlbPolicy = parse_tlb_policy(argv[i + 3]);
+            if (tlbPolicy < 0) {
+                printf("%s: Unknown TLB policy %s\n", argv[0], argv[i + 3]);
+                return EXIT_FAILURE;
             }
-
-            if (temp->lru > max) {
-                max = temp->lru;
-                lru_set = temp;
+            if (sscanf(argv[i + 1], "%d", &tlbEntries) != 1 || sscanf(argv[i + 2], "%d", &tlbWays) != 1
+                    || (dtlb = create_tlb(tlbEntries, tlbWays, tlbPolicy)) == NULL) {
+                printf("%s: Bad TLB geometry %s entries, %s ways\n", argv[0], argv[i + 1], argv[i + 2]);
+                return EXIT_FAILURE;
             }
-            temp = temp->more_recent;
-            counter++;
+            i += 3;
         }
-
-        if (temp != NULL) {
-            target_block = temp->data;
-            target_index = temp;
+        else if (strcmp(argv[i], "--walk-cache") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &walkEntries);
         }
-
-        else if (comp == 1) {
-            target_block = cold_block;
-            target_index = cold_index;
+        else if (strcmp(argv[i], "--walk-refs") == 0) {
+            walkRefs = 1;
         }
-
-        else {
-            int startAddress = currAddress - blockoff;
-            read_from_memory(d_buff, startAddress, blockSize);
-            unsigned char val_load[accessSize];
-            for (int j = 0; j < accessSize; j++) {
-                val_load[j] = d_buff[blockoff + j];
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 2 < argc) {
+            checkpointFile = argv[i + 1];
+            checkpointEvery = (long) atof(argv[i + 2]);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restoreFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stop-after") == 0 && i + 1 < argc) {
+            stopAfter = (long) atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            numPolicies = parse_policy_list(argv[++i], policies, SWEEP_MAX_VALUES);
+            policy = policies[0];
+            policyGiven = 1;
+            if (numPolicies < 1) {
+                printf("%s: Unknown replacement policy %s\n", argv[0], argv[i]);
+                return EXIT_FAILURE;
             }
         }
-
-
-
-        int pointless = 0;
-        if (instruction_buffer[0] == 'l') {
-
-            if (hit == 1) { //HIT
-                is_miss = 0;
-                unsigned char output[(accessSize * 2) + 1];
-                unsigned char* ptr = &output[0];
-                for (int i = 0; i < accessSize; i++) {
-                    ptr += sprintf(ptr, "%02x", target_block[blockoff + i]);
-                }
-                printf("load 0x%x hit %s\n", other, output);
-                target_index->lru = 0;
-                target_index->tag = ctag;
-                actually_used = target_index;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%u", &seed);
+        }
+        else if (strcmp(argv[i], "--write-through") == 0) {
+            writeThrough = 1;
+        }
+        else if (strcmp(argv[i], "--no-write-allocate") == 0) {
+            noWriteAllocate = 1;
+        }
+        else if (strcmp(argv[i], "--write-buffer") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &writeBuffer);
+        }
+        else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            prefetch = parse_prefetcher(argv[++i]);
+            if (prefetch < 0) {
+                printf("%s: Unknown prefetcher %s\n", argv[0], argv[i]);
+                return EXIT_FAILURE;
             }
-
-            else if (comp == 1) {  //COLD MISS
-                //printf("you detected a cold miss\n");
-                is_miss = 0;
-                unsigned char output[(accessSize * 2) + 1];
-                unsigned char* ptr = &output[0];
-                for (int i = 0; i < blockSize; i++) {
-                    target_block[i] = 0;
-                }
-                for (int i = 0; i < accessSize; i++) {
-                    ptr += sprintf(ptr, "%02x", target_block[blockoff + i]);
-                }
-                printf("load 0x%x miss %s\n", other, output);
-                target_index->lru = 0;
-                target_index->valid = 1;
-                target_index->tag = ctag;
-                actually_used = target_index;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+                sscanf(argv[++i], "%d", &prefetchDegree);
             }
-            else {  //CONFLICT MISS
-                is_miss = 1;
-                unsigned char* aim_block = lru_set->data;
-                if (lru_set->dirty == 1) {
-                    int startAddress1 = currAddress - blockoff;
-                    write_to_memory(aim_block, startAddress1, blockSize);
-                }
-
-                for (int i = 0; i < blockSize; i++) {
-                    *(aim_block + i) = *(d_buff + i);
-                }
-
-                unsigned char output1[(accessSize * 2) + 1];
-                unsigned char* ptr1 = &output1[0];
-                for (int i = 0; i < accessSize; i++) {
-                    ptr1 += sprintf(ptr1, "%02x", aim_block[blockoff + i]);
-                    // printf("valload: %d", val_load[blockoff+i]);
-                }
-                //printf("\n");
-
-                lru_set->valid = 1;
-                lru_set->dirty = 0;
-                lru_set->tag = ctag;
-                lru_set->lru = 0;
-                //printf("you detected a conflict miss\n");
-                printf("load 0x%x miss %s\n", other, output1);
-                actually_used = lru_set;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            printStats = 1;
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0) {
+            printStats = 1;
+            statsJson = 1;
+            quiet = 1;
+        }
+        else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = 1;
+        }
+        else if (strcmp(argv[i], "--sweep") == 0) {
+            sweepMode = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &threads);
+        }
+        else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            sampleRate = atof(argv[++i]);
+            if (sampleRate <= 0.0 || sampleRate > 1.0) {
+                printf("%s: Sampling rate must be in (0, 1], got %s\n", argv[0], argv[i]);
+                return EXIT_FAILURE;
             }
+            // sampling only applies to sweeps and miss-ratio curves
+            sweepMode = 1;
         }
-
-
-        //STORE
-        else {
-            unsigned char data_buffer[64], * pos = data_buffer;
-            fscanf(myFile, "%s", pos);
-            unsigned char val[accessSize + 1];
-            size_t count = 0;
-            unsigned int byteval;
-            while (sscanf(pos, "%2x", &byteval) == 1) {
-                val[count] = byteval;
-                count++;
-                pos += 2 * sizeof(unsigned char);
+        else if (strcmp(argv[i], "--hierarchy") == 0 && i + 1 < argc) {
+            hierarchyFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipelined = 1;
+        }
+        else if (strcmp(argv[i], "--timing") == 0) {
+            timed = 1;
+        }
+        else if (strcmp(argv[i], "--latency") == 0 && i + 2 < argc) {
+            sscanf(argv[i + 1], "%d", &hitLatency);
+            sscanf(argv[i + 2], "%d", &memoryLatency);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "--mshrs") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &numMshrs);
+        }
+        else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+            coreTraces = argv[++i];
+        }
+        else if (strcmp(argv[i], "--protocol") == 0 && i + 1 < argc) {
+            protocol = parse_protocol(argv[++i]);
+            if (protocol < 0) {
+                printf("%s: Unknown coherence protocol %s\n", argv[0], argv[i]);
+                return EXIT_FAILURE;
             }
-
-            if (hit == 1) { //hit
-                is_miss = 0;
-                for (int i = 0; i < accessSize; i++) {
-                    target_block[blockoff + i] = val[i];
-                }
-                target_index->dirty = 1;
-                printf("store 0x%x hit\n", other);
-                target_index->lru = 0;
-                target_index->valid = 1;
-                target_index->tag = ctag;
-                actually_used = target_index;
+        }
+        else if (strcmp(argv[i], "--interleave") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "rr") == 0) {
+                interleave = COH_ROUND_ROBIN;
+            }
+            else if (strcmp(argv[i], "time") == 0) {
+                interleave = COH_TIMED;
             }
-
-
-            //MISS
             else {
-                is_miss = 1;
-
-                unsigned char* aim_block = lru_set->data;
-
-                if (lru_set->dirty == 1) {
-                    int startAddress1 = currAddress - blockoff;
-                    write_to_memory(aim_block, startAddress1, blockSize);
-                }
-
-                for (int i = 0; i < accessSize; i++) {
-                    *(aim_block + (i + blockoff)) = *(val + i);
-                }
+                printf("%s: Unknown interleaving %s\n", argv[0], argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--mrc") == 0) {
+            mrcMode = 1;
+        }
+        else if (strcmp(argv[i], "--json") == 0) {
+            sweepMode = 1;
+            json = 1;
+        }
+        else {
+            printf("%s: Unknown option %s\n", argv[0], argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (numPolicies > 1) {
+        sweepMode = 1;
+    }
+    // Radix tables: TLB misses go to a page walker, with a page-walk cache
+    // if asked for
+    page_walker* walker = NULL;
+    if (dtlb != NULL && ptable->levels > 0) {
+        walker = create_walker(walkEntries);
+        if (walker == NULL) {
+            printf("%s: Page-walk cache entries must be 0 to %d\n", argv[0], PWC_MAX_ENTRIES);
+            return EXIT_FAILURE;
+        }
+        dtlb->walker = walker;
+    }
+    else if (walkEntries > 0 || walkRefs) {
+        printf("%s: --walk-cache and --walk-refs need --tlb and a radix page table\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (walkRefs && (coreTraces != NULL || mrcMode || sweepMode || policy == REPL_OPT)) {
+        printf("%s: --walk-refs only works on a single cache or --hierarchy, without opt\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int checkpointing = checkpointFile != NULL || restoreFile != NULL || stopAfter >= 0;
+    if (checkpointing && (coreTraces != NULL || mrcMode || sweepMode || hierarchyFile != NULL
+            || policy == REPL_OPT || checkpointEvery < 0)) {
+        printf("%s: Checkpoints only work on a single cache, without opt\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (coreTraces != NULL && (dtlb != NULL || writeThrough || noWriteAllocate || writeBuffer > 0
+            || prefetch != PF_NONE || printStats || timed)) {
+        // the coherent caches are plain write-back ones translated straight
+        // through the page table, and coherence has its own report
+        printf("%s: --cores doesn't take --tlb, write policy, --write-buffer, --prefetch, --stats or --timing\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (hierarchyFile != NULL && (policyGiven || writeThrough || noWriteAllocate || writeBuffer > 0
+            || prefetch != PF_NONE || printStats)) {
+        // every level takes its policy from the config file and reports its own totals
+        printf("%s: --hierarchy doesn't take --policy, write policy, --write-buffer, --prefetch or --stats\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+    if ((sweepMode || mrcMode) && (writeThrough || noWriteAllocate || writeBuffer > 0
+            || prefetch != PF_NONE || printStats || timed)) {
+        // sweep rows and miss-ratio curves only count hits and misses
+        printf("%s: Sweeps and --mrc don't take write policy, --write-buffer, --prefetch, --stats or --timing\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+    timing* timer = NULL;
+    if (timed) {
+        timer = create_timing(numMshrs);
+        if (timer == NULL || hitLatency < 0 || memoryLatency < 0) {
+            printf("%s: MSHRs must be 1 to %d and latencies not negative\n", argv[0], TIMING_MAX_MSHRS);
+            return EXIT_FAILURE;
+        }
+    }
 
-                lru_set->valid = 1;
-                lru_set->dirty = 0;
-                lru_set->tag = ctag;
-                lru_set->lru = 0;
-                printf("store 0x%x miss\n", other);
-                actually_used = lru_set;
+    // Multi-core: one private cache per trace, kept coherent
+    if (coreTraces != NULL) {
+        trace_reader* traces[COH_MAX_CORES] = {trace};
+        const char* names[COH_MAX_CORES] = {argv[2]};
+        int numCores = 1;
+        for (char* name = strtok(coreTraces, ","); name != NULL; name = strtok(NULL, ",")) {
+            if (numCores == COH_MAX_CORES) {
+                printf("%s: At most %d cores\n", argv[0], COH_MAX_CORES);
+                return EXIT_FAILURE;
             }
+            traces[numCores] = open_trace(name);
+            if (traces[numCores] == NULL) {
+                printf("%s: Could not read trace %s\n", argv[0], name);
+                return EXIT_FAILURE;
+            }
+            names[numCores++] = name;
+        }
+        cache_config cfg = {.size_kb = cacheSize, .assoc = associativity, .block_size = blockSize,
+            .policy = policy, .seed = seed};
+        coherence* coh = create_coherence(&cfg, numCores, protocol);
+        if (coh == NULL) {
+            printf("%s: Bad cache geometry or policy for --cores\n", argv[0]);
+            return EXIT_FAILURE;
         }
+        for (int i = 0; i < numCores; i++) {
+            coh->cores[i].name = names[i];
+        }
+        run_coherence(coh, traces, ptable, interleave);
+        print_coherence_stats(coh, interleave);
+        destroy_coherence(coh);
+        for (int i = 0; i < numCores; i++) {
+            close_trace(traces[i]);
+        }
+        destroy_page_table(ptable);
+        destroy_memory();
+        return EXIT_SUCCESS;
+    }
 
-        if (associativity > 1) {
-            set_node* header = cache[index];
-            while (header != NULL) {
-                if (header == actually_used) {
-                    header = header->more_recent;
-                }
-                else {
-                    header->lru = (header->lru) + 1;
-                    header = header->more_recent;
+    // Hierarchy: every access goes through the levels in the config file
+    if (hierarchyFile != NULL) {
+        hierarchy* hier = load_hierarchy(hierarchyFile, seed);
+        if (hier == NULL) {
+            return EXIT_FAILURE;
+        }
+        const trace_record* rec;
+        int status;
+        while ((status = next_record(trace, &rec)) != 0) {
+            if (status < 0) {
+                fprintf(stderr, "%s:%ld: malformed trace record, skipped\n", argv[2], trace->line);
+                continue;
+            }
+            int pa = (dtlb != NULL) ? tlb_translate(dtlb, ptable, trace_vaddr(rec))
+                : translate_address(ptable, trace_vaddr(rec));
+            for (int i = 0; walkRefs && i < walker->last.nrefs; i++) {
+                int pteHit = hierarchy_access(hier, walker->last.refs[i], RADIX_PTE_SIZE, 0);
+                walker->injected++;
+                walker->injected_hits += pteHit;
+                if (timer != NULL) {
+                    timing_access(timer, (unsigned int) walker->last.refs[i] >> hier->levels[0].c->bbits,
+                        pteHit ? 0 : hierarchy_miss_latency(hier, hier->served), hier->levels[0].latency);
                 }
-
             }
+            if (walker != NULL) walker->last.nrefs = 0;
+            if (pa == PAGEFAULT_ADDR) {
+                continue;
+            }
+            int hit = hierarchy_access(hier, pa, rec->size, rec->op == TRACE_STORE);
+            if (timer != NULL) {
+                timing_access(timer, (unsigned int) pa >> hier->levels[0].c->bbits,
+                    hit ? 0 : hierarchy_miss_latency(hier, hier->served), hier->levels[0].latency);
+            }
+        }
+        print_hierarchy_stats(hier);
+        if (dtlb != NULL) {
+            print_tlb_stats(dtlb);
+            destroy_tlb(dtlb);
         }
+        if (timer != NULL) {
+            print_timing_stats(timer);
+            destroy_timing(timer);
+        }
+        destroy_hierarchy(hier);
+        close_trace(trace);
+        destroy_page_table(ptable);
+        destroy_memory();
+        return EXIT_SUCCESS;
     }
-    //free memory
-  /*  for (int i = 0; i < index; i++) {
-        set_node* head = cache[i];
-        set_node* tmp;
-        if (associativity > 1) {
-            while (head != NULL) {
-                int* currblk = head->data;
-                free(currblk);
-                tmp = head;
-                head = head->more_recent;
-                free(tmp);
+
+    // Miss-ratio curves: one stack-distance analysis per block size, all
+    // fed from the same pass over the trace
+    if (mrcMode) {
+        mrc* curves[SWEEP_MAX_VALUES];
+        for (int i = 0; i < numBlocks; i++) {
+            curves[i] = create_mrc(blocks[i], sampleRate);
+        }
+        const trace_record* rec;
+        int status;
+        while ((status = next_record(trace, &rec)) != 0) {
+            if (status < 0) {
+                fprintf(stderr, "%s:%ld: malformed trace record, skipped\n", argv[2], trace->line);
+                continue;
+            }
+            int pa = (dtlb != NULL) ? tlb_translate(dtlb, ptable, trace_vaddr(rec))
+                : translate_address(ptable, trace_vaddr(rec));
+            if (pa == PAGEFAULT_ADDR) {
+                continue;
+            }
+            for (int i = 0; i < numBlocks; i++) {
+                mrc_access_range(curves[i], (unsigned int) pa, rec->size);
             }
         }
-        else {
-            int* currblk = head->data;
-            free(currblk);
-            free(head);
+        print_mrc(curves, numBlocks, json);
+        for (int i = 0; i < numBlocks; i++) {
+            destroy_mrc(curves[i]);
         }
-    }*/
-    //printf("%s", "really");
-    destroy_memory();
-    //printf("%s", "really");
-    return EXIT_SUCCESS;
-}
+        destroy_tlb(dtlb);
+        close_trace(trace);
+        destroy_page_table(ptable);
+        destroy_memory();
+        return EXIT_SUCCESS;
+    }
 
+    // Sweep: every combination side by side over one pass of the trace
+    if (sweepMode) {
+        sweep* sw = create_sweep(sizes, numSizes, assocs, numAssocs, blocks, numBlocks,
+            policies, numPolicies, seed, sampleRate);
+        if (sw == NULL) {
+            printf("%s: No usable cache configuration in the sweep\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        run_sweep(sw, trace, ptable, dtlb, threads);
+        if (sw->malformed > 0) {
+            fprintf(stderr, "%s: %ld malformed trace records skipped\n", argv[2], sw->malformed);
+        }
+        print_sweep(sw, json);
+        destroy_sweep(sw);
+        destroy_tlb(dtlb);
+        close_trace(trace);
+        destroy_page_table(ptable);
+        destroy_memory();
+        return EXIT_SUCCESS;
+    }
 
+    if (prefetch != PF_NONE && policy == REPL_OPT) {
+        // prefetch fills would throw off OPT's view of the future
+        printf("%s: Prefetching doesn't work with opt replacement\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (prefetchDegree == 0) {
+        prefetchDegree = (prefetch == PF_STREAM) ? 4 : (prefetch == PF_STRIDE) ? 2 : 1;
+    }
+    if (prefetchDegree < 1 || prefetchDegree > PF_MAX_DEGREE) {
+        printf("%s: Prefetch degree must be 1 to %d\n", argv[0], PF_MAX_DEGREE);
+        return EXIT_FAILURE;
+    }
+    cache_config config = {.size_kb = cacheSize, .assoc = associativity, .block_size = blockSize,
+        .policy = policy, .seed = seed, .write_through = writeThrough, .no_write_allocate = noWriteAllocate,
+        .write_buffer = writeBuffer, .prefetch = prefetch, .prefetch_degree = prefetchDegree};
+    cache* dcache = create_cache(&config, 1);
+    if (dcache == NULL) {
+        printf("%s: Bad cache geometry for %s replacement\n", argv[0], repl_policy_name(policy));
+        return EXIT_FAILURE;
+    }
 
+    // OPT needs the next use of every access before the simulation starts
+    long* nextUse = NULL;
+    if (policy == REPL_OPT) {
+        long numBlocks;
+        long* blocks = scan_block_trace(trace, ptable, dcache->bbits, &numBlocks);
+        nextUse = compute_next_use(blocks, numBlocks);
+        repl_set_future(dcache->repl, nextUse, numBlocks);
+        free(blocks);
+    }
 
 
-int virt2phys(int va, char* fileName)
-{
-    
-    //char* vadd = *(argv + 2);
-    //int addlen = strlen(va);
-    //addlen = addlen * 4;
-    int addbits;
-    int pgsz;
-    int pgoffsz;
-    int bivadd = va;
-    int x;
+    // --quiet drops the per-access output but still prints the totals
+    printStats |= quiet;
+    output_writer* out = quiet ? NULL : create_writer(STDOUT_FILENO);
+    run_stats* stats = printStats ? create_stats(dcache) : NULL;
 
-  
-    FILE* f;
-    f = fopen(fileName, "r");
-    if (f == NULL) {
-        return 0;
+    sim_state state = {.trace = trace, .c = dcache, .t = dtlb, .pt = ptable, .stats = stats, .timer = timer};
+    if (restoreFile != NULL && restore_checkpoint(restoreFile, &state) != 0) {
+        printf("%s: Could not restore %s, or it was saved from another trace or setup\n", argv[0], restoreFile);
+        return EXIT_FAILURE;
     }
-    fscanf(f, "%d", &addbits);
-    fscanf(f, "%d", &pgsz);
-    //sscanf(va, "%x", &bivadd);
+    long startRecords = state.records;
+
+    // Keep reading records until the end of the trace, on a pipeline of
+    // threads if asked for and they can start
+    if (!pipelined || timer != NULL || walkRefs || checkpointing
+            || run_pipeline(trace, argv[2], ptable, dtlb, dcache, stats, out) != 0) {
+        const trace_record* rec;
+        int status;
+        for (;;) {
+            int stopping = (state.records == stopAfter);
+            if (checkpointFile != NULL && state.records != startRecords
+                    && (stopping || (checkpointEvery > 0 && state.records % checkpointEvery == 0))
+                    && save_checkpoint(checkpointFile, &state) != 0) {
+                fprintf(stderr, "%s: could not write checkpoint %s\n", argv[0], checkpointFile);
+            }
+            if (stopping || (status = next_record(trace, &rec)) == 0) {
+                break;
+            }
+            state.records++;
+            if (status < 0) {
+                fprintf(stderr, "%s:%ld: malformed trace record, skipped\n", argv[2], trace->line);
+                if (stats != NULL) stats->malformed++;
+                continue;
+            }
+            unsigned long long other = trace_vaddr(rec);
+            int accessSize = rec->size;
+            int currAddress;
+            if (dtlb != NULL) {
+                currAddress = tlb_translate(dtlb, ptable, other);
+            }
+            else {
+                currAddress = translate_address(ptable, other);
+            }
+            // the walk's reads come first, the access needs their result
+            for (int i = 0; walkRefs && i < walker->last.nrefs; i++) {
+                unsigned char pte[RADIX_PTE_SIZE];
+                int pteHit = cache_load(dcache, walker->last.refs[i], RADIX_PTE_SIZE, pte);
+                walker->injected++;
+                walker->injected_hits += pteHit;
+                if (stats != NULL) stats_access(stats, walker->last.refs[i], RADIX_PTE_SIZE, 0, pteHit);
+                if (timer != NULL) {
+                    timing_access(timer, (unsigned int) walker->last.refs[i] >> dcache->bbits,
+                        pteHit ? 0 : memoryLatency, hitLatency);
+                }
+            }
+            if (walker != NULL) walker->last.nrefs = 0;
+            if (currAddress == PAGEFAULT_ADDR) {
+                if (out != NULL) write_pagefault(out);
+                if (stats != NULL) stats->page_faults++;
+                continue;
+            }
+
+            int hit;
+            if (rec->op == TRACE_LOAD) {
+                unsigned char val[accessSize];
+                hit = cache_load(dcache, currAddress, accessSize, val);
+                if (out != NULL) write_load(out, other, hit, val, accessSize);
+            }
 
-    //log
-    int n = pgsz;
-    int r = 0;
-    while (n >>= 1) r++;
-    pgoffsz = r;
 
-    //bit mask VA 
-    unsigned int tot_mask = 4294967295;
-    int shift_mask = tot_mask << (pgoffsz);
-    //get upper bits
-    unsigned int vpn = bivadd & shift_mask;
-    //get lower bits
-    int oset = bivadd - vpn;
-    
-    vpn = vpn >> pgoffsz;
-   
-    if (bivadd == 0) {
-        oset = 0;
-        vpn = 0;
+            //STORE
+            else {
+                hit = cache_store(dcache, currAddress, accessSize, rec->data);
+                if (out != NULL) write_store(out, other, hit);
+            }
+            if (timer != NULL) {
+                // a store that doesn't allocate never waits for the block
+                int fetched = !hit && !(rec->op == TRACE_STORE && noWriteAllocate);
+                timing_access(timer, (unsigned int) currAddress >> dcache->bbits,
+                    fetched ? memoryLatency : 0, hitLatency);
+            }
+            if (stats != NULL) stats_access(stats, currAddress, accessSize, rec->op == TRACE_STORE, hit);
+        }
     }
-    int i = 0;
-    char s1[24];
-    while (!fscanf(f, "%s\n", s1) != EOF)
-    {
-        if (i == vpn) {
-            break;
-        }
-        i++;
+    // flush before the totals go out through stdio
+    destroy_writer(out);
+    cache_drain(dcache);
+    if (printStats) {
+        print_stats(stats, dcache, dtlb, statsJson);
+        destroy_stats(stats);
     }
-    rewind(f);
-    fclose(f);
-  
-    int ppn = atoi(s1);
-  
-    int pa;
-    if (oset ==0 && vpn ==0) {
-        return 0;
+    if (dtlb != NULL) {
+        if (!statsJson) print_tlb_stats(dtlb);
+        destroy_tlb(dtlb);
     }
-    if (ppn == -1) {
-        
-        pa = NULL;
-       
-        return;
-        //return 0;
+    if (timer != NULL) {
+        if (!statsJson) print_timing_stats(timer);
+        destroy_timing(timer);
     }
-    
-    ppn = ppn << pgoffsz;
-    pa = ppn | oset;
-   
-
-    return pa;
+    //printf("%s", "really");
+    destroy_cache(dcache);
+    close_trace(trace);
+    free(nextUse);
+    destroy_page_table(ptable);
+    destroy_memory();
+    //printf("%s", "really");
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,568 @@
+/**
+ * checkpoint.c - Checkpoint and restore of a cachesimplus run
+ * Saves the whole state of a single-cache run to a binary file and picks
+ * the run up from it later, where it left off in the trace
+ *
+ * A checkpoint is CKPT_MAGIC, the number of trace records read, then one
+ * section per part of the run: where the trace is up to, memory.c's
+ * nonzero pages, the cache (tags, dirty bits, block data, replacement
+ * state, write buffer and prefetcher), and the TLB, statistics and timing
+ * if the run has them. Each section starts with its geometry, so a
+ * checkpoint only restores into a run set up the same way. Sections the
+ * restoring run has no use for are skipped, so one warmed-up checkpoint
+ * can start runs with or without --stats, --timing or output. Every index
+ * read back (list links, ring buffer heads and counts, time slots) is
+ * checked against the arrays it points into before the run goes on.
+ *
+ * Data is written in the machine's own layout, like binary traces, and
+ * saves go to a temporary file renamed into place, so a run killed while
+ * saving leaves the previous checkpoint intact.
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "memory.h"
+#include "checkpoint.h"
+
+// Definitions ================================================================
+static int put(FILE* f, const void* p, size_t n) {
+	return (n == 0 || fwrite(p, n, 1, f) == 1) ? 0 : -1;
+}
+
+static int get(FILE* f, void* p, size_t n) {
+	return (n == 0 || fread(p, n, 1, f) == 1) ? 0 : -1;
+}
+
+// Writes "shape" on save; on restore reads it back and fails unless it matches
+static int put_shape(FILE* f, const int* shape, size_t n) {
+	return put(f, shape, n * sizeof(int));
+}
+
+static int check_shape(FILE* f, const int* shape, size_t n) {
+	int saved[16];
+	return (get(f, saved, n * sizeof(int)) == 0 && memcmp(saved, shape, n * sizeof(int)) == 0) ? 0 : -1;
+}
+
+// FNV-1a over the (up to) CKPT_TRACE_WINDOW bytes of the trace before
+// "offset", with the trace's size, so a checkpoint can tell its trace
+// from another one of the same length
+static unsigned long long trace_fingerprint(const trace_reader* t, long offset) {
+	struct stat st;
+	if (fstat(fileno(t->file), &st) != 0) {
+		return 0;
+	}
+	unsigned char window[CKPT_TRACE_WINDOW];
+	long start = (offset > CKPT_TRACE_WINDOW) ? offset - CKPT_TRACE_WINDOW : 0;
+	ssize_t n = (offset <= st.st_size) ? pread(fileno(t->file), window, offset - start, start) : -1;
+	unsigned long long hash = 14695981039346656037ull ^ (unsigned long long) st.st_size;
+	for (ssize_t i = 0; i < n; i++) {
+		hash = (hash ^ window[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// Byte offset of the next record, whatever the format
+static long trace_bytes(const trace_reader* t) {
+	long pos = tell_trace(t);
+	return t->binary ? TRACE_HEADER_SIZE + pos * (long) sizeof(trace_record) : pos;
+}
+
+static int save_trace(FILE* f, const trace_reader* t) {
+	long pos[2] = {tell_trace(t), t->line};
+	unsigned long long hash = trace_fingerprint(t, trace_bytes(t));
+	return put(f, pos, sizeof(pos)) | put(f, &hash, sizeof(hash));
+}
+
+static int restore_trace(FILE* f, trace_reader* t) {
+	long pos[2];
+	unsigned long long hash;
+	if (get(f, pos, sizeof(pos)) != 0 || get(f, &hash, sizeof(hash)) != 0 || seek_trace(t, pos[0], pos[1]) != 0) {
+		return -1;
+	}
+	return (hash == trace_fingerprint(t, trace_bytes(t))) ? 0 : -1;
+}
+
+// The policy's arrays; OPT's depend on the future, so it isn't checkpointed
+static int repl_arrays(FILE* f, repl_state* r, int (*io)(FILE*, void*, size_t)) {
+	size_t lines = (size_t) r->nsets * r->assoc;
+	switch (r->policy) {
+	case REPL_LRU:
+		return io(f, r->lru_prev, lines * sizeof(int)) | io(f, r->lru_next, lines * sizeof(int))
+			| io(f, r->lru_head, r->nsets * sizeof(int)) | io(f, r->lru_tail, r->nsets * sizeof(int));
+	case REPL_PLRU:
+		return io(f, r->bits, r->nsets * (size_t) (r->assoc > 1 ? r->assoc - 1 : 1));
+	case REPL_FIFO:
+		return io(f, r->fifo_next, r->nsets * sizeof(int));
+	case REPL_SRRIP:
+	case REPL_BRRIP:
+		return io(f, r->bits, lines);
+	case REPL_OPT:
+		return -1;
+	}
+	return 0;
+}
+
+// FIFO's next way must be in its set, and each LRU set one list through
+// all its ways, head to tail
+static int check_repl(const repl_state* r) {
+	for (int set = 0; set < r->nsets; set++) {
+		if (r->policy == REPL_FIFO && (r->fifo_next[set] < 0 || r->fifo_next[set] >= r->assoc)) {
+			return -1;
+		}
+		if (r->policy != REPL_LRU) {
+			continue;
+		}
+		const int* prev = r->lru_prev + set * r->assoc;
+		const int* next = r->lru_next + set * r->assoc;
+		int last = -1, n = 0;
+		for (int way = r->lru_head[set]; way != -1; way = next[way]) {
+			if (way < 0 || way >= r->assoc || n == r->assoc || prev[way] != last) {
+				return -1;
+			}
+			last = way;
+			n++;
+		}
+		if (n != r->assoc || r->lru_tail[set] != last) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int write_buffer_arrays(FILE* f, write_buffer* wb, int (*io)(FILE*, void*, size_t)) {
+	size_t bytes = (size_t) wb->entries * wb->block_size;
+	return io(f, wb->block, wb->entries * sizeof(int)) | io(f, wb->data, bytes) | io(f, wb->mask, bytes);
+}
+
+static int prefetcher_arrays(FILE* f, prefetcher* p, int (*io)(FILE*, void*, size_t)) {
+	int status = 0;
+	for (int i = 0; i < PF_STREAMS && p->kind == PF_STREAM; i++) {
+		status |= io(f, p->streams[i].block, p->degree * sizeof(int));
+		status |= io(f, p->streams[i].data, (size_t) p->degree * p->block_size);
+	}
+	return status;
+}
+
+// Geometry and options that must match for the tags and data to mean the same thing
+static void cache_shape(const cache* c, int* shape) {
+	shape[0] = c->size_kb;
+	shape[1] = c->assoc;
+	shape[2] = c->block_size;
+	shape[3] = c->repl->policy;
+	shape[4] = c->write_through;
+	shape[5] = c->no_write_allocate;
+	shape[6] = (c->wbuf != NULL) ? c->wbuf->entries : 0;
+	shape[7] = (c->pf != NULL) ? c->pf->kind : PF_NONE;
+	shape[8] = (c->pf != NULL) ? c->pf->degree : 0;
+	shape[9] = (c->data != NULL);
+}
+
+#define CACHE_SHAPE 10
+
+// Reads or writes the cache's contents, its policy's state and its counters
+static int cache_contents(FILE* f, cache* c, int (*io)(FILE*, void*, size_t)) {
+	size_t lines = (size_t) c->nsets * c->assoc;
+	int status = io(f, c->tags, lines * sizeof(int)) | io(f, c->dirty, lines)
+		| io(f, c->valid_ways, c->nsets * sizeof(int));
+	if (c->data != NULL) {
+		status |= io(f, c->data, lines * c->block_size);
+	}
+	if (c->prefetched != NULL) {
+		status |= io(f, c->prefetched, lines);
+	}
+	long* counters[] = {&c->hits, &c->misses, &c->writebacks, &c->evictions, &c->store_bytes,
+		&c->read_bytes, &c->written_bytes, &c->memory_writes};
+	for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+		status |= io(f, counters[i], sizeof(long));
+	}
+	status |= io(f, &c->repl->seed, sizeof(c->repl->seed)) | repl_arrays(f, c->repl, io);
+	return status;
+}
+
+// valid_ways must count the set's valid tags, since fills trust it
+static int check_cache(const cache* c) {
+	for (int set = 0; set < c->nsets; set++) {
+		int valid = 0;
+		for (int way = 0; way < c->assoc; way++) {
+			valid += (c->tags[set * c->assoc + way] != INVALID_TAG);
+		}
+		if (valid != c->valid_ways[set]) {
+			return -1;
+		}
+	}
+	return check_repl(c->repl);
+}
+
+static int put_any(FILE* f, void* p, size_t n) {
+	return put(f, p, n);
+}
+
+static int save_cache(FILE* f, const cache* c) {
+	int shape[CACHE_SHAPE];
+	cache_shape(c, shape);
+	int status = put_shape(f, shape, CACHE_SHAPE) | cache_contents(f, (cache*) c, put_any);
+	if (c->wbuf != NULL) {
+		status |= put(f, c->wbuf, sizeof(write_buffer)) | write_buffer_arrays(f, c->wbuf, put_any);
+	}
+	if (c->pf != NULL) {
+		status |= put(f, c->pf, sizeof(prefetcher)) | prefetcher_arrays(f, c->pf, put_any);
+	}
+	return status;
+}
+
+static int restore_cache(FILE* f, cache* c) {
+	int shape[CACHE_SHAPE];
+	cache_shape(c, shape);
+	if (check_shape(f, shape, CACHE_SHAPE) != 0 || cache_contents(f, c, get) != 0 || check_cache(c) != 0) {
+		return -1;
+	}
+	// the structs are read whole, then their arrays put back under them
+	if (c->wbuf != NULL) {
+		write_buffer* wb = c->wbuf;
+		write_buffer live = *wb;
+		if (get(f, wb, sizeof(write_buffer)) != 0) {
+			return -1;
+		}
+		wb->block = live.block;
+		wb->data = live.data;
+		wb->mask = live.mask;
+		if (wb->entries != live.entries || wb->block_size != live.block_size || wb->bbits != live.bbits
+				|| wb->count < 0 || wb->count > wb->entries || wb->head < 0 || wb->head >= wb->entries
+				|| write_buffer_arrays(f, wb, get) != 0) {
+			return -1;
+		}
+	}
+	if (c->pf != NULL) {
+		prefetcher* p = c->pf;
+		prefetcher live = *p;
+		if (get(f, p, sizeof(prefetcher)) != 0 || p->kind != live.kind || p->degree != live.degree
+				|| p->block_size != live.block_size || p->bbits != live.bbits) {
+			return -1;
+		}
+		for (int i = 0; i < PF_STREAMS; i++) {
+			stream_buffer* s = &p->streams[i];
+			s->block = live.streams[i].block;
+			s->data = live.streams[i].data;
+			if (s->count < 0 || s->count > p->degree || s->head < 0 || s->head >= p->degree) {
+				return -1;
+			}
+		}
+		if (prefetcher_arrays(f, p, get) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void tlb_shape(const tlb* t, int* shape) {
+	shape[0] = t->entries;
+	shape[1] = t->ways;
+	shape[2] = t->policy;
+	shape[3] = (t->walker != NULL) ? t->walker->entries : -1;
+}
+
+static int tlb_contents(FILE* f, tlb* t, int (*io)(FILE*, void*, size_t)) {
+	size_t n = t->entries;
+	int status = io(f, t->vpn, n * sizeof(unsigned long long)) | io(f, t->ppn, n * sizeof(int))
+		| io(f, t->valid, n) | io(f, t->huge, n) | io(f, t->last_use, n * sizeof(unsigned long))
+		| io(f, &t->tick, sizeof(t->tick)) | io(f, &t->seed, sizeof(t->seed))
+		| io(f, &t->hits, sizeof(long)) | io(f, &t->misses, sizeof(long))
+		| io(f, &t->page_faults, sizeof(long)) | io(f, &t->huge_hits, sizeof(long));
+	if (t->walker != NULL) {
+		page_walker* w = t->walker;
+		pwc_entry* pwc = w->pwc;
+		int entries = w->entries;
+		status |= io(f, w, sizeof(page_walker));
+		w->pwc = pwc;
+		if (w->entries != entries) {
+			return -1;
+		}
+		status |= io(f, pwc, w->entries * sizeof(pwc_entry));
+	}
+	return status;
+}
+
+// The latest walk and the page-walk cache's entries must fit page table "pt"
+static int check_walker(const page_walker* w, const page_table* pt) {
+	if (w->last.nrefs < 0 || w->last.nrefs > RADIX_MAX_LEVELS) {
+		return -1;
+	}
+	for (int i = 0; i < w->entries; i++) {
+		const pwc_entry* e = &w->pwc[i];
+		if (e->depth != 0 && (e->depth < 1 || e->depth >= pt->levels || e->node < 0 || e->node >= pt->num_nodes)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int save_tlb(FILE* f, const tlb* t) {
+	int shape[4];
+	tlb_shape(t, shape);
+	return put_shape(f, shape, 4) | tlb_contents(f, (tlb*) t, put_any);
+}
+
+static int restore_tlb(FILE* f, tlb* t, const page_table* pt) {
+	int shape[4];
+	tlb_shape(t, shape);
+	if (check_shape(f, shape, 4) != 0 || tlb_contents(f, t, get) != 0) {
+		return -1;
+	}
+	return (t->walker != NULL) ? check_walker(t->walker, pt) : 0;
+}
+
+static int save_stats(FILE* f, const run_stats* s) {
+	const mrc* m = s->shadow;
+	return put(f, s, sizeof(run_stats)) | put(f, m, sizeof(mrc))
+		| put(f, m->hist, m->hist_len * sizeof(long)) | put(f, m->keys, m->map_cap * sizeof(long))
+		| put(f, m->last, m->map_cap * sizeof(long)) | put(f, m->tree, (m->tree_cap + 1) * sizeof(int))
+		| put(f, m->owner, m->tree_cap * sizeof(long));
+}
+
+/**
+ * Checks the links of a restored shadow: every block in the map owns the
+ * time slot of its latest access and nothing else, and the Fenwick tree
+ * counts exactly the owned slots, so stack distances stay in range.
+ */
+static int check_shadow(const mrc* m) {
+	if (m->distinct < 0 || m->distinct > m->now || m->now > m->tree_cap || 2 * m->distinct > m->map_cap) {
+		return -1;
+	}
+	long blocks = 0;
+	for (long h = 0; h < m->map_cap; h++) {
+		if (m->keys[h] == -1) {
+			continue;
+		}
+		if (m->keys[h] < 0 || m->last[h] < 0 || m->last[h] >= m->now || m->owner[m->last[h]] != h) {
+			return -1;
+		}
+		blocks++;
+	}
+	if (blocks != m->distinct) {
+		return -1;
+	}
+	int* tree = (int*) calloc(m->tree_cap + 1, sizeof(int));
+	if (tree == NULL) {
+		return -1;
+	}
+	int status = 0;
+	for (long i = 1; i <= m->tree_cap && status == 0; i++) {
+		long h = (i <= m->now) ? m->owner[i - 1] : -1;
+		if (h != -1 && (h < 0 || h >= m->map_cap || m->keys[h] == -1 || m->last[h] != i - 1)) {
+			status = -1;
+		}
+		tree[i] += (h != -1);
+		long parent = i + (i & -i);
+		if (parent <= m->tree_cap) {
+			tree[parent] += tree[i];
+		}
+	}
+	if (status == 0 && memcmp(tree, m->tree, (m->tree_cap + 1) * sizeof(int)) != 0) {
+		status = -1;
+	}
+	free(tree);
+	return status;
+}
+
+// The shadow's tables grow as it goes, so they're sized from the checkpoint,
+// bounded by the section's "len" bytes, and swapped in once all are read
+static int restore_stats(FILE* f, run_stats* s, long len) {
+	run_stats saved;
+	mrc* m = s->shadow;
+	mrc shadow;
+	long fixed = (long) (sizeof(run_stats) + sizeof(mrc));
+	if (len < fixed || get(f, &saved, sizeof(saved)) != 0 || saved.lines != s->lines
+			|| get(f, &shadow, sizeof(shadow)) != 0 || shadow.block_size != m->block_size
+			|| shadow.bbits != m->bbits || shadow.rate != m->rate || shadow.threshold != m->threshold) {
+		return -1;
+	}
+	long room = len - fixed;
+	if (shadow.hist_len < 1 || shadow.hist_len > room / (long) sizeof(long)
+			|| shadow.map_cap < 1 || shadow.map_cap > room / (long) (2 * sizeof(long))
+			|| (shadow.map_cap & (shadow.map_cap - 1)) != 0
+			|| shadow.tree_cap < 1 || shadow.tree_cap > room / (long) (sizeof(int) + sizeof(long))
+			|| shadow.hist_len * (long) sizeof(long) + shadow.map_cap * (long) (2 * sizeof(long))
+				+ (shadow.tree_cap + 1) * (long) sizeof(int) + shadow.tree_cap * (long) sizeof(long) != room) {
+		return -1;
+	}
+	shadow.hist = (long*) malloc(shadow.hist_len * sizeof(long));
+	shadow.keys = (long*) malloc(shadow.map_cap * sizeof(long));
+	shadow.last = (long*) malloc(shadow.map_cap * sizeof(long));
+	shadow.tree = (int*) malloc((shadow.tree_cap + 1) * sizeof(int));
+	shadow.owner = (long*) malloc(shadow.tree_cap * sizeof(long));
+	int status = (shadow.hist != NULL && shadow.keys != NULL && shadow.last != NULL && shadow.tree != NULL
+		&& shadow.owner != NULL) ? 0 : -1;
+	if (status == 0) {
+		status = get(f, shadow.hist, shadow.hist_len * sizeof(long)) | get(f, shadow.keys, shadow.map_cap * sizeof(long))
+			| get(f, shadow.last, shadow.map_cap * sizeof(long)) | get(f, shadow.tree, (shadow.tree_cap + 1) * sizeof(int))
+			| get(f, shadow.owner, shadow.tree_cap * sizeof(long));
+	}
+	if (status == 0) {
+		status = check_shadow(&shadow);
+	}
+	if (status != 0) {
+		free(shadow.hist);
+		free(shadow.keys);
+		free(shadow.last);
+		free(shadow.tree);
+		free(shadow.owner);
+		return -1;
+	}
+	free(m->hist);
+	free(m->keys);
+	free(m->last);
+	free(m->tree);
+	free(m->owner);
+	*m = shadow;
+	saved.shadow = m;
+	*s = saved;
+	return 0;
+}
+
+static int restore_timing(FILE* f, timing* t) {
+	timing saved;
+	if (get(f, &saved, sizeof(saved)) != 0 || saved.nmshrs != t->nmshrs) {
+		return -1;
+	}
+	*t = saved;
+	return 0;
+}
+
+// Writes the tag and a length to fill in once the section is done
+static long begin_section(FILE* f, int tag) {
+	long len = 0;
+	if (put(f, &tag, sizeof(tag)) != 0 || put(f, &len, sizeof(len)) != 0) {
+		return -1;
+	}
+	return ftell(f);
+}
+
+static int end_section(FILE* f, long start, int status) {
+	long end = ftell(f);
+	long len = end - start;
+	if (status != 0 || start < 0 || fseek(f, start - (long) sizeof(len), SEEK_SET) != 0
+			|| put(f, &len, sizeof(len)) != 0 || fseek(f, end, SEEK_SET) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Saves run "s" to "fileName", replacing any checkpoint there only once
+ * the new one is complete. Returns 0, or -1 if it couldn't be written.
+ */
+int save_checkpoint(const char* fileName, const sim_state* s) {
+	size_t len = strlen(fileName);
+	char* tmpName = (char*) malloc(len + 5);
+	memcpy(tmpName, fileName, len);
+	memcpy(tmpName + len, ".tmp", 5);
+	FILE* f = fopen(tmpName, "wb");
+	if (f == NULL) {
+		free(tmpName);
+		return -1;
+	}
+
+	int status = put(f, CKPT_MAGIC, CKPT_MAGIC_LEN) | put(f, &s->records, sizeof(s->records));
+	long start = begin_section(f, CKPT_TRACE);
+	status |= end_section(f, start, save_trace(f, s->trace));
+	start = begin_section(f, CKPT_MEMORY);
+	status |= end_section(f, start, save_memory(f));
+	start = begin_section(f, CKPT_CACHE);
+	status |= end_section(f, start, save_cache(f, s->c));
+	if (s->t != NULL) {
+		start = begin_section(f, CKPT_TLB);
+		status |= end_section(f, start, save_tlb(f, s->t));
+	}
+	if (s->stats != NULL) {
+		start = begin_section(f, CKPT_STATS);
+		status |= end_section(f, start, save_stats(f, s->stats));
+	}
+	if (s->timer != NULL) {
+		start = begin_section(f, CKPT_TIMING);
+		status |= end_section(f, start, put(f, s->timer, sizeof(timing)));
+	}
+	start = begin_section(f, CKPT_END);
+	status |= end_section(f, start, 0);
+
+	if (fclose(f) != 0 || status != 0 || rename(tmpName, fileName) != 0) {
+		remove(tmpName);
+		status = -1;
+	}
+	free(tmpName);
+	return status;
+}
+
+/**
+ * Puts run "s", set up as when the checkpoint was saved, back in the state
+ * saved in "fileName", ready to read the next record.
+ * Returns 0, or -1 if the file is unreadable, from another trace or
+ * configuration, or lacks a part "s" has (a TLB, statistics or timing).
+ */
+int restore_checkpoint(const char* fileName, sim_state* s) {
+	FILE* f = fopen(fileName, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+	char magic[CKPT_MAGIC_LEN];
+	int status = (get(f, magic, CKPT_MAGIC_LEN) == 0 && memcmp(magic, CKPT_MAGIC, CKPT_MAGIC_LEN) == 0
+		&& get(f, &s->records, sizeof(s->records)) == 0) ? 0 : -1;
+	int found = 0;
+	while (status == 0) {
+		int tag;
+		long len;
+		if (get(f, &tag, sizeof(tag)) != 0 || get(f, &len, sizeof(len)) != 0 || len < 0) {
+			status = -1;
+			break;
+		}
+		if (tag == CKPT_END) {
+			break;
+		}
+		long start = ftell(f);
+		int restored = 1;
+		switch (tag) {
+		case CKPT_TRACE:
+			status = restore_trace(f, s->trace);
+			break;
+		case CKPT_MEMORY:
+			status = restore_memory(f);
+			break;
+		case CKPT_CACHE:
+			status = restore_cache(f, s->c);
+			break;
+		case CKPT_TLB:
+			restored = (s->t != NULL);
+			if (restored) status = restore_tlb(f, s->t, s->pt);
+			break;
+		case CKPT_STATS:
+			restored = (s->stats != NULL);
+			if (restored) status = restore_stats(f, s->stats, len);
+			break;
+		case CKPT_TIMING:
+			restored = (s->timer != NULL);
+			if (restored) status = restore_timing(f, s->timer);
+			break;
+		default:
+			restored = 0;
+		}
+		if (restored) {
+			found |= 1 << tag;
+			if (ftell(f) != start + len) {
+				status = -1;
+			}
+		}
+		if (status == 0 && fseek(f, start + len, SEEK_SET) != 0) {
+			status = -1;
+		}
+	}
+	fclose(f);
+
+	int needed = (1 << CKPT_TRACE) | (1 << CKPT_MEMORY) | (1 << CKPT_CACHE);
+	needed |= (s->t != NULL) << CKPT_TLB | (s->stats != NULL) << CKPT_STATS | (s->timer != NULL) << CKPT_TIMING;
+	return (status == 0 && (found & needed) == needed) ? 0 : -1;
+}
+// ============================================================================
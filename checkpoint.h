@@ -0,0 +1,45 @@
+/**
+ * checkpoint.h - Checkpoint and restore of a cachesimplus run
+ * Saves the whole state of a single-cache run to a binary file and picks
+ * the run up from it later, where it left off in the trace
+ **/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "trace.h"
+#include "cache.h"
+#include "tlb.h"
+#include "stats.h"
+#include "timing.h"
+
+#define CKPT_MAGIC "CSIMCKP1"
+#define CKPT_MAGIC_LEN 8
+#define CKPT_TRACE_WINDOW 4096 // trace bytes fingerprinted before the saved offset
+
+// Section tags; each section is a tag, its length in bytes, then the data
+#define CKPT_END 0
+#define CKPT_TRACE 1
+#define CKPT_MEMORY 2
+#define CKPT_CACHE 3
+#define CKPT_TLB 4
+#define CKPT_STATS 5
+#define CKPT_TIMING 6
+
+// Everything a run carries from one record to the next
+typedef struct sim_state {
+	trace_reader* trace;
+	cache* c;
+	tlb* t;               // NULL without a TLB
+	const page_table* pt; // what the TLB's page-walk cache points into
+	run_stats* stats;     // NULL without --stats
+	timing* timer;        // NULL without --timing
+	long records;         // trace records read so far, malformed ones too
+} sim_state;
+
+// Signatures =================================================================
+int save_checkpoint(const char* fileName, const sim_state* s);
+int restore_checkpoint(const char* fileName, sim_state* s);
+// ============================================================================
+
+#endif
@@ -0,0 +1,402 @@
+/**
+ * coherence.c - Multi-core simulation for cachesimplus
+ * One private tag-only cache per core, each fed by its own trace, kept
+ * coherent with MESI or MOESI over a snooping bus
+ *
+ * Every miss or upgrade goes on the bus and is snooped by the other
+ * caches. A load miss (BusRd) leaves other copies shared; under MESI a
+ * modified copy is written back first, under MOESI it becomes the owner
+ * and keeps supplying the block. A store miss (BusRdX) or a store to a
+ * shared line (BusUpgr) invalidates every other copy. Dirty blocks are
+ * passed between caches, clean ones come from memory.
+ *
+ * A miss on a block the core last lost to another core's store is a
+ * coherence miss. It is also a false sharing miss when none of the bytes
+ * it touches were stored to by another core since, which is tracked per
+ * block with a byte mask (word mask for blocks over 64 bytes).
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "coherence.h"
+
+// Definitions ================================================================
+int parse_protocol(const char* name) {
+	if (strcmp(name, "mesi") == 0) return COH_MESI;
+	if (strcmp(name, "moesi") == 0) return COH_MOESI;
+	return -1;
+}
+
+/**
+ * Creates "ncores" empty private caches with geometry "cfg".
+ * Returns NULL on a bad core count or geometry, or for OPT.
+ */
+coherence* create_coherence(const cache_config* cfg, int ncores, int protocol) {
+	// OPT would need each core's future as its cache sees it, which
+	// depends on the interleaving
+	if (ncores < 1 || ncores > COH_MAX_CORES || cfg->policy == REPL_OPT) {
+		return NULL;
+	}
+	coherence* h = (coherence*) calloc(1, sizeof(coherence));
+	h->protocol = protocol;
+	h->ncores = ncores;
+	for (int i = 0; i < ncores; i++) {
+		coh_core* k = &h->cores[i];
+		k->c = create_cache(cfg, 0);
+		if (k->c == NULL) {
+			destroy_coherence(h);
+			return NULL;
+		}
+		k->state = (unsigned char*) calloc((size_t) k->c->nsets * k->c->assoc, sizeof(unsigned char));
+	}
+	h->bbits = h->cores[0].c->bbits;
+	h->mask_shift = (h->bbits > 6) ? h->bbits - 6 : 0;
+	h->block_cap = 1024;
+	h->blocks = (coh_block*) malloc(h->block_cap * sizeof(coh_block));
+	for (long i = 0; i < h->block_cap; i++) {
+		h->blocks[i].block = COH_NO_BLOCK;
+	}
+	return h;
+}
+
+void destroy_coherence(coherence* h) {
+	if (h == NULL) {
+		return;
+	}
+	for (int i = 0; i < h->ncores; i++) {
+		destroy_cache(h->cores[i].c);
+		free(h->cores[i].state);
+	}
+	free(h->blocks);
+	free(h);
+}
+
+static long find_slot(const coh_block* blocks, long cap, unsigned int block) {
+	unsigned long h = ((unsigned long) block * 0x9E3779B97F4A7C15ul) & (cap - 1);
+	while (blocks[h].block != COH_NO_BLOCK && blocks[h].block != block) {
+		h = (h + 1) & (cap - 1);
+	}
+	return h;
+}
+
+// Doubles the block table, keeping it at most half full
+static void grow_blocks(coherence* h) {
+	long cap = h->block_cap * 2;
+	coh_block* blocks = (coh_block*) malloc(cap * sizeof(coh_block));
+	for (long i = 0; i < cap; i++) {
+		blocks[i].block = COH_NO_BLOCK;
+	}
+	for (long i = 0; i < h->block_cap; i++) {
+		if (h->blocks[i].block != COH_NO_BLOCK) {
+			blocks[find_slot(blocks, cap, h->blocks[i].block)] = h->blocks[i];
+		}
+	}
+	free(h->blocks);
+	h->blocks = blocks;
+	h->block_cap = cap;
+}
+
+/**
+ * Returns the history of "block", adding an empty one if "create" is set.
+ * Returns NULL if the block has none and "create" isn't set.
+ */
+static coh_block* find_block(coherence* h, unsigned int block, int create) {
+	long slot = find_slot(h->blocks, h->block_cap, block);
+	if (h->blocks[slot].block != COH_NO_BLOCK) {
+		return &h->blocks[slot];
+	}
+	if (!create) {
+		return NULL;
+	}
+	if (2 * (h->block_count + 1) > h->block_cap) {
+		grow_blocks(h);
+		slot = find_slot(h->blocks, h->block_cap, block);
+	}
+	coh_block* b = &h->blocks[slot];
+	memset(b, 0, sizeof(coh_block));
+	b->block = block;
+	h->block_count++;
+	return b;
+}
+
+// Mask of the bytes (or words) "offset" to "offset" + "len" - 1 of a block
+static unsigned long long byte_mask(const coherence* h, int offset, int len) {
+	int first = offset >> h->mask_shift;
+	int n = ((offset + len - 1) >> h->mask_shift) - first + 1;
+	unsigned long long bits = (n >= 64) ? ~0ull : (1ull << n) - 1;
+	return bits << first;
+}
+
+/**
+ * Snoops the block at "address" in every cache but "core"'s. For a BusRd
+ * the other copies end up shared; for a BusRdX or BusUpgr ("exclusive")
+ * they are invalidated, and their cores remember the bytes "mask" stored.
+ * "others" gets whether any other cache held the block.
+ * Returns 1 if a dirty copy could supply the block.
+ */
+static int snoop(coherence* h, int core, int address, int exclusive, unsigned long long mask, int* others) {
+	unsigned int block = (unsigned int) address >> h->bbits;
+	int supplied = 0;
+	*others = 0;
+	for (int i = 0; i < h->ncores; i++) {
+		coh_core* k = &h->cores[i];
+		int line = (i == core) ? -1 : cache_find_line(k->c, address);
+		if (line < 0) {
+			continue;
+		}
+		int st = k->state[line];
+		*others = 1;
+		supplied |= (st == COH_M || st == COH_O);
+		if (exclusive) {
+			// ownership, and with it any dirty data, moves to the requester
+			cache_invalidate(k->c, address);
+			k->state[line] = COH_I;
+			k->invalidations++;
+			coh_block* b = find_block(h, block, 1);
+			b->lost |= 1u << i;
+			b->written[i] = mask;
+			b->invalidations++;
+		}
+		else if (st == COH_M && h->protocol == COH_MOESI) {
+			k->state[line] = COH_O;
+		}
+		else if (st == COH_M) {
+			h->memory_writes++;
+			k->c->writebacks++;
+			k->c->dirty[line] = 0;
+			k->state[line] = COH_S;
+		}
+		else if (st == COH_E) {
+			k->state[line] = COH_S;
+		}
+	}
+	return supplied;
+}
+
+// Counts a miss by "core" as a coherence miss if another core's store took the block away
+static void classify_miss(coherence* h, int core, unsigned int block, unsigned long long mask) {
+	coh_block* b = find_block(h, block, 0);
+	if (b == NULL || !(b->lost & (1u << core))) {
+		return;
+	}
+	coh_core* k = &h->cores[core];
+	b->lost &= ~(1u << core);
+	b->coherence_misses++;
+	k->coherence_misses++;
+	if ((b->written[core] & mask) == 0) {
+		b->false_sharing++;
+		k->false_sharing++;
+	}
+}
+
+// Adds a store by "core" to the bytes every core that lost the block has missed
+static void record_store(coherence* h, int core, unsigned int block, unsigned long long mask) {
+	if (h->block_count == 0) {
+		return;
+	}
+	coh_block* b = find_block(h, block, 0);
+	if (b == NULL) {
+		return;
+	}
+	for (int i = 0; i < h->ncores; i++) {
+		if (i != core && (b->lost & (1u << i))) {
+			b->written[i] |= mask;
+		}
+	}
+}
+
+// One load or store by "core" within the block at "address". Returns the cycles it took.
+static int access_block(coherence* h, int core, int address, int offset, int len, int is_store) {
+	coh_core* k = &h->cores[core];
+	unsigned int block = (unsigned int) address >> h->bbits;
+	unsigned long long mask = byte_mask(h, offset, len);
+	int others;
+	int cycles = COH_HIT_CYCLES;
+	if (cache_lookup(k->c, address, is_store)) {
+		int line = cache_find_line(k->c, address);
+		if (is_store && (k->state[line] == COH_S || k->state[line] == COH_O)) {
+			h->bus_upgrades++;
+			k->upgrades++;
+			snoop(h, core, address, 1, mask, &others);
+		}
+		if (is_store) {
+			k->state[line] = COH_M;
+		}
+	}
+	else {
+		classify_miss(h, core, block, mask);
+		if (is_store) {
+			h->bus_read_exclusive++;
+		}
+		else {
+			h->bus_reads++;
+		}
+		if (snoop(h, core, address, is_store, mask, &others)) {
+			h->transfers++;
+			cycles = COH_TRANSFER_CYCLES;
+		}
+		else {
+			h->memory_reads++;
+			cycles = COH_MEMORY_CYCLES;
+		}
+
+		// the victim's state is still in the line the block goes into
+		int victim;
+		int evicted = cache_fill(k->c, address, is_store, &victim);
+		if (evicted > 0) {
+			h->memory_writes++;
+			k->c->writebacks++;
+		}
+		int line = cache_find_line(k->c, address);
+		k->state[line] = is_store ? COH_M : (others ? COH_S : COH_E);
+	}
+	if (is_store) {
+		record_store(h, core, block, mask);
+	}
+	return cycles;
+}
+
+/**
+ * Runs one load or store of "size" bytes at physical "address" by "core",
+ * a block at a time, and advances the core's clock.
+ * Returns 1 if every block hit.
+ */
+int coherence_access(coherence* h, int core, int address, int size, int is_store) {
+	coh_core* k = &h->cores[core];
+	int block_size = 1 << h->bbits;
+	long misses = k->c->misses;
+	if (is_store) {
+		k->stores++;
+	}
+	else {
+		k->loads++;
+	}
+	do {
+		int offset = address & (block_size - 1);
+		int len = (size < block_size - offset) ? size : block_size - offset;
+		k->clock += access_block(h, core, address - offset, offset, len, is_store);
+		address += len;
+		size -= len;
+	} while (size > 0);
+	return k->c->misses == misses;
+}
+
+/**
+ * Feeds "core" its next record. Returns 0 once its trace is done.
+ */
+static int step(coherence* h, int core, trace_reader* trace, const page_table* pt) {
+	coh_core* k = &h->cores[core];
+	const trace_record* rec;
+	int status = next_record(trace, &rec);
+	if (status == 0) {
+		return 0;
+	}
+	if (status < 0) {
+		k->malformed++;
+		return 1;
+	}
+	int pa = translate_address(pt, trace_vaddr(rec));
+	if (pa == PAGEFAULT_ADDR) {
+		k->page_faults++;
+		return 1;
+	}
+	coherence_access(h, core, pa, rec->size, rec->op == TRACE_STORE);
+	return 1;
+}
+
+/**
+ * Runs core i's trace "traces[i]" through its cache until every trace is
+ * done. All cores share the page table, as threads of one process would.
+ */
+void run_coherence(coherence* h, trace_reader** traces, const page_table* pt, int interleave) {
+	int done[COH_MAX_CORES] = {0};
+	int active = h->ncores;
+	while (active > 0) {
+		if (interleave == COH_ROUND_ROBIN) {
+			for (int i = 0; i < h->ncores; i++) {
+				if (!done[i] && !step(h, i, traces[i], pt)) {
+					done[i] = 1;
+					active--;
+				}
+			}
+			continue;
+		}
+		// lowest clock first, ties to the lowest core
+		int next = -1;
+		for (int i = 0; i < h->ncores; i++) {
+			if (!done[i] && (next < 0 || h->cores[i].clock < h->cores[next].clock)) {
+				next = i;
+			}
+		}
+		if (!step(h, next, traces[next], pt)) {
+			done[next] = 1;
+			active--;
+		}
+	}
+}
+
+static int by_false_sharing(const void* a, const void* b) {
+	const coh_block* x = *(const coh_block* const*) a;
+	const coh_block* y = *(const coh_block* const*) b;
+	if (x->false_sharing != y->false_sharing) {
+		return (x->false_sharing < y->false_sharing) ? 1 : -1;
+	}
+	if (x->invalidations != y->invalidations) {
+		return (x->invalidations < y->invalidations) ? 1 : -1;
+	}
+	return (x->block > y->block) - (x->block < y->block);
+}
+
+static double percent(long part, long whole) {
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+/**
+ * Prints per-core totals, bus and memory traffic, and the blocks with the
+ * most false sharing misses.
+ */
+void print_coherence_stats(const coherence* h, int interleave) {
+	const cache* c0 = h->cores[0].c;
+	printf("Cores: %d, %dkB, %d-way, %dB blocks, %s, %s, %s\n", h->ncores, c0->size_kb, c0->assoc,
+		c0->block_size, repl_policy_name(c0->repl->policy), h->protocol == COH_MOESI ? "MOESI" : "MESI",
+		interleave == COH_TIMED ? "timed" : "round-robin");
+	for (int i = 0; i < h->ncores; i++) {
+		const coh_core* k = &h->cores[i];
+		const cache* c = k->c;
+		printf("Core %d (%s): loads: %ld stores: %ld page faults: %ld\n", i, k->name, k->loads, k->stores,
+			k->page_faults);
+		printf("Core %d hits: %ld misses: %ld hit rate: %.2f%%\n", i, c->hits, c->misses,
+			percent(c->hits, c->hits + c->misses));
+		printf("Core %d coherence misses: %ld (%.2f%%) false sharing: %ld upgrades: %ld "
+			"invalidations: %ld writebacks: %ld\n", i, k->coherence_misses,
+			percent(k->coherence_misses, c->misses), k->false_sharing, k->upgrades, k->invalidations,
+			c->writebacks);
+		if (interleave == COH_TIMED) {
+			printf("Core %d cycles: %ld\n", i, k->clock);
+		}
+		if (k->malformed > 0) {
+			printf("Core %d malformed records skipped: %ld\n", i, k->malformed);
+		}
+	}
+	printf("Bus: reads: %ld read-exclusive: %ld upgrades: %ld cache-to-cache: %ld\n", h->bus_reads,
+		h->bus_read_exclusive, h->bus_upgrades, h->transfers);
+	printf("Memory: reads: %ld writes: %ld\n", h->memory_reads, h->memory_writes);
+
+	const coh_block** hot = (const coh_block**) malloc((h->block_count + 1) * sizeof(coh_block*));
+	long n = 0;
+	for (long i = 0; i < h->block_cap; i++) {
+		if (h->blocks[i].block != COH_NO_BLOCK && h->blocks[i].false_sharing > 0) {
+			hot[n++] = &h->blocks[i];
+		}
+	}
+	qsort(hot, n, sizeof(coh_block*), by_false_sharing);
+	printf("False sharing hotspots: %ld blocks\n", n);
+	for (long i = 0; i < n && i < COH_HOTSPOTS; i++) {
+		printf("  0x%x: false sharing misses: %ld coherence misses: %ld invalidations: %ld\n",
+			hot[i]->block << h->bbits, hot[i]->false_sharing, hot[i]->coherence_misses,
+			hot[i]->invalidations);
+	}
+	free(hot);
+}
+// ============================================================================
@@ -0,0 +1,89 @@
+/**
+ * coherence.h - Multi-core simulation for cachesimplus
+ * One private tag-only cache per core, each fed by its own trace, kept
+ * coherent with MESI or MOESI over a snooping bus
+ **/
+
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include "cache.h"
+#include "pagetable.h"
+#include "trace.h"
+
+#define COH_MAX_CORES 16
+#define COH_HOTSPOTS 10       // blocks listed in the false sharing report
+
+#define COH_MESI 0
+#define COH_MOESI 1
+
+// How the per-core traces are merged into one access stream
+#define COH_ROUND_ROBIN 0     // one record from each core in turn
+#define COH_TIMED 1           // next record from the core with the lowest clock
+
+// Line states, kept next to each cache's tags
+#define COH_I 0
+#define COH_S 1
+#define COH_E 2
+#define COH_O 3               // MOESI only: dirty and shared, this cache answers for it
+#define COH_M 4
+
+// Simulated cycles per block, for timed interleaving
+#define COH_HIT_CYCLES 1
+#define COH_TRANSFER_CYCLES 20 // block supplied by another cache
+#define COH_MEMORY_CYCLES 100
+
+typedef struct coh_core {
+	const char* name;     // trace file
+	cache* c;             // tag-only, dirty exactly in M and O
+	unsigned char* state; // [nsets * assoc], COH_*
+	long loads;
+	long stores;
+	long page_faults;
+	long malformed;
+	long coherence_misses; // misses on blocks another core's store took away
+	long false_sharing;    // of those, misses on bytes no other core stored to since
+	long upgrades;         // stores to a shared line, invalidating the other copies
+	long invalidations;    // copies lost to other cores' stores
+	long clock;            // simulated cycles
+} coh_core;
+
+// Sharing history of one block that has been invalidated somewhere
+typedef struct coh_block {
+	unsigned int block;   // block number, COH_NO_BLOCK for an empty slot
+	unsigned int lost;    // cores whose copy was invalidated and not fetched again
+	unsigned long long written[COH_MAX_CORES]; // per lost core, bytes stored by others since
+	long invalidations;
+	long coherence_misses;
+	long false_sharing;
+} coh_block;
+
+#define COH_NO_BLOCK 0xffffffffu
+
+typedef struct coherence {
+	int protocol;         // COH_MESI or COH_MOESI
+	int ncores;
+	coh_core cores[COH_MAX_CORES];
+	int bbits;
+	int mask_shift;       // log2 of the bytes per bit of a written mask
+	coh_block* blocks;    // open-addressed by block number
+	long block_cap;
+	long block_count;
+	long bus_reads;       // BusRd, a load miss
+	long bus_read_exclusive; // BusRdX, a store miss
+	long bus_upgrades;    // BusUpgr, a store hit on a shared line
+	long transfers;       // misses served by another cache
+	long memory_reads;
+	long memory_writes;
+} coherence;
+
+// Signatures =================================================================
+int parse_protocol(const char* name);
+coherence* create_coherence(const cache_config* cfg, int ncores, int protocol);
+void destroy_coherence(coherence* h);
+int coherence_access(coherence* h, int core, int address, int size, int is_store);
+void run_coherence(coherence* h, trace_reader** traces, const page_table* pt, int interleave);
+void print_coherence_stats(const coherence* h, int interleave);
+// ============================================================================
+
+#endif
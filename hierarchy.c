@@ -0,0 +1,289 @@
+/**
+ * hierarchy.c - Multi-level cache hierarchy for cachesimplus
+ * A chain of tag-only caches read from a config file, where the misses of
+ * one level are looked up in the next and the last level misses to memory
+ *
+ * Config file: one level per line, closest to the core first,
+ *     <name> <size kB> <ways> <block size> <policy> <hit cycles> [inclusive|exclusive|nine]
+ * and a "memory <cycles>" line. Blank lines and '#' comments are ignored.
+ * The inclusion keyword says how a level treats the levels above it and
+ * defaults to nine. Block sizes can't shrink going down, so a block
+ * fetched from below always covers the whole block above.
+ *
+ * Every level is write-back and write-allocate. A dirty victim is written
+ * into the next level (allocating it there if it's missing); an exclusive
+ * level takes clean victims as well, since that's the only way it fills.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "hierarchy.h"
+
+// Definitions ================================================================
+static int parse_inclusion(const char* name) {
+	if (strcmp(name, "nine") == 0) return HIER_NINE;
+	if (strcmp(name, "inclusive") == 0) return HIER_INCLUSIVE;
+	if (strcmp(name, "exclusive") == 0) return HIER_EXCLUSIVE;
+	return -1;
+}
+
+static const char* inclusion_name(int inclusion) {
+	static const char* names[] = {"nine", "inclusive", "exclusive"};
+	return names[inclusion];
+}
+
+/**
+ * Reads a hierarchy from "fileName". Problems are reported on stderr with
+ * their line number. Returns NULL if the file can't be read or is invalid.
+ */
+hierarchy* load_hierarchy(const char* fileName, unsigned int seed) {
+	FILE* f = fopen(fileName, "r");
+	if (f == NULL) {
+		fprintf(stderr, "%s: could not read hierarchy\n", fileName);
+		return NULL;
+	}
+
+	hierarchy* h = (hierarchy*) calloc(1, sizeof(hierarchy));
+	h->memory_latency = -1;
+	char line[256];
+	int lineNo = 0;
+	int ok = 1;
+	while (ok && fgets(line, sizeof(line), f) != NULL) {
+		lineNo++;
+		char* hash = strchr(line, '#');
+		if (hash != NULL) *hash = '\0';
+
+		char name[HIER_NAME_LEN], policy[16], inclusion[16] = "nine";
+		cache_config cfg = {0}; // write-back, write-allocate, no write buffer or prefetcher
+		int latency;
+		int fields = sscanf(line, "%15s %d %d %d %15s %d %15s", name, &cfg.size_kb, &cfg.assoc,
+			&cfg.block_size, policy, &latency, inclusion);
+		if (fields <= 0) {
+			continue;
+		}
+		if (strcmp(name, "memory") == 0 && fields == 2) {
+			h->memory_latency = cfg.size_kb;
+			continue;
+		}
+		if (fields < 6) {
+			fprintf(stderr, "%s:%d: expected <name> <kB> <ways> <block size> <policy> <cycles> [inclusion]\n",
+				fileName, lineNo);
+			ok = 0;
+			break;
+		}
+
+		cfg.policy = parse_repl_policy(policy);
+		cfg.seed = seed;
+		int incl = parse_inclusion(inclusion);
+		if (h->nlevels == HIER_MAX_LEVELS) {
+			fprintf(stderr, "%s:%d: more than %d levels\n", fileName, lineNo, HIER_MAX_LEVELS);
+			ok = 0;
+		}
+		else if (cfg.policy < 0 || cfg.policy == REPL_OPT) {
+			// OPT needs the access stream of each level ahead of time
+			fprintf(stderr, "%s:%d: unsupported replacement policy %s\n", fileName, lineNo, policy);
+			ok = 0;
+		}
+		else if (incl < 0 || (incl == HIER_EXCLUSIVE && h->nlevels == 0)) {
+			fprintf(stderr, "%s:%d: bad inclusion %s\n", fileName, lineNo, inclusion);
+			ok = 0;
+		}
+		else if (h->nlevels > 0 && cfg.block_size < h->levels[h->nlevels - 1].c->block_size) {
+			fprintf(stderr, "%s:%d: block size smaller than the level above\n", fileName, lineNo);
+			ok = 0;
+		}
+		else {
+			hier_level* l = &h->levels[h->nlevels];
+			l->c = create_cache(&cfg, 0);
+			if (l->c == NULL) {
+				fprintf(stderr, "%s:%d: bad cache geometry\n", fileName, lineNo);
+				ok = 0;
+			}
+			else {
+				strcpy(l->name, name);
+				l->latency = latency;
+				l->inclusion = incl;
+				h->nlevels++;
+			}
+		}
+	}
+	fclose(f);
+
+	if (ok && (h->nlevels == 0 || h->memory_latency < 0)) {
+		fprintf(stderr, "%s: need at least one level and a memory line\n", fileName);
+		ok = 0;
+	}
+	if (!ok) {
+		destroy_hierarchy(h);
+		return NULL;
+	}
+	return h;
+}
+
+void destroy_hierarchy(hierarchy* h) {
+	if (h == NULL) {
+		return;
+	}
+	for (int i = 0; i < h->nlevels; i++) {
+		destroy_cache(h->levels[i].c);
+	}
+	free(h);
+}
+
+static void evict(hierarchy* h, int level, int victim, int dirty);
+
+/**
+ * Puts the block holding "address" into "level" with the given dirty bit
+ * and sends whatever it displaces further down.
+ */
+static void insert(hierarchy* h, int level, int address, int dirty) {
+	int victim;
+	int evicted = cache_fill(h->levels[level].c, address, dirty, &victim);
+	if (evicted >= 0) {
+		evict(h, level, victim, evicted);
+	}
+}
+
+/**
+ * Handles a block leaving "level". An inclusive level first pulls every
+ * copy out of the levels above, picking up their dirty data. A dirty
+ * block is then written back below; an exclusive level below takes clean
+ * ones too.
+ */
+static void evict(hierarchy* h, int level, int victim, int dirty) {
+	hier_level* l = &h->levels[level];
+	if (l->inclusion == HIER_INCLUSIVE) {
+		for (int up = 0; up < level; up++) {
+			cache* c = h->levels[up].c;
+			for (int off = 0; off < l->c->block_size; off += c->block_size) {
+				int was = cache_invalidate(c, victim + off);
+				if (was >= 0) {
+					l->back_invalidations++;
+					dirty |= was;
+				}
+			}
+		}
+	}
+	if (dirty) {
+		l->c->writebacks++;
+	}
+
+	int below = level + 1;
+	if (below == h->nlevels) {
+		if (dirty) h->memory_writes++;
+		return;
+	}
+	hier_level* next = &h->levels[below];
+	if (next->inclusion == HIER_EXCLUSIVE) {
+		// an exclusive level never holds a block above it, but if block
+		// sizes differ keep a single copy
+		int was = cache_invalidate(next->c, victim);
+		insert(h, below, victim, dirty | (was > 0));
+	}
+	else if (dirty && !cache_mark_dirty(next->c, victim)) {
+		insert(h, below, victim, 1);
+	}
+}
+
+/**
+ * Brings the block holding "address" up from "level" on behalf of the
+ * level above. Returns the dirty bit the block arrives with: an exclusive
+ * level hands its copy, and with it any dirty data, over to the requester.
+ */
+static int fetch(hierarchy* h, int level, int address) {
+	if (level == h->nlevels) {
+		h->memory_reads++;
+		h->served = level;
+		return 0;
+	}
+	hier_level* l = &h->levels[level];
+	if (cache_lookup(l->c, address, 0)) {
+		if (level > h->served) {
+			h->served = level;
+		}
+		if (l->inclusion == HIER_EXCLUSIVE) {
+			return cache_invalidate(l->c, address);
+		}
+		return 0;
+	}
+
+	int dirty = fetch(h, level + 1, address);
+	if (l->inclusion == HIER_EXCLUSIVE) {
+		return dirty;
+	}
+	insert(h, level, address, dirty);
+	return 0;
+}
+
+/**
+ * Runs one load or store of "size" bytes at physical "address" through
+ * the hierarchy, once for each first-level block it touches.
+ * Returns 1 if every block hit in the first level.
+ */
+int hierarchy_access(hierarchy* h, int address, int size, int is_store) {
+	cache* l1 = h->levels[0].c;
+	h->served = 0;
+	unsigned int first = (unsigned int) address >> l1->bbits;
+	unsigned int last = ((unsigned int) address + size - 1) >> l1->bbits;
+	int hit = 1;
+	for (unsigned int b = first; ; b++) {
+		int block = (int) (b << l1->bbits);
+		if (!cache_lookup(l1, block, is_store)) {
+			int dirty = fetch(h, 1, block);
+			insert(h, 0, block, dirty | is_store);
+			hit = 0;
+		}
+		if (b == last) break;
+	}
+	return hit;
+}
+
+/**
+ * Cycles beyond the first level's hit latency to bring a block up from
+ * "level" (nlevels for memory), looking it up in every level on the way.
+ */
+int hierarchy_miss_latency(const hierarchy* h, int level) {
+	int cycles = 0;
+	for (int i = 1; i <= level && i < h->nlevels; i++) {
+		cycles += h->levels[i].latency;
+	}
+	if (level == h->nlevels) {
+		cycles += h->memory_latency;
+	}
+	return cycles;
+}
+
+/**
+ * Average memory access time in cycles, from each level's hit latency and
+ * local miss rate: t(i) = latency(i) + miss rate(i) * t(i + 1), with
+ * memory at the bottom.
+ */
+double hierarchy_amat(const hierarchy* h) {
+	double t = h->memory_latency;
+	for (int i = h->nlevels - 1; i >= 0; i--) {
+		const cache* c = h->levels[i].c;
+		long accesses = c->hits + c->misses;
+		double miss_rate = accesses ? (double) c->misses / accesses : 0.0;
+		t = h->levels[i].latency + miss_rate * t;
+	}
+	return t;
+}
+
+void print_hierarchy_stats(const hierarchy* h) {
+	for (int i = 0; i < h->nlevels; i++) {
+		const hier_level* l = &h->levels[i];
+		const cache* c = l->c;
+		long accesses = c->hits + c->misses;
+		double hit_rate = accesses ? 100.0 * c->hits / accesses : 0.0;
+		printf("%s: %dkB, %d-way, %dB blocks, %s, %s, %d cycles\n", l->name, c->size_kb, c->assoc,
+			c->block_size, repl_policy_name(c->repl->policy), inclusion_name(l->inclusion), l->latency);
+		printf("%s hits: %ld misses: %ld hit rate: %.2f%%\n", l->name, c->hits, c->misses, hit_rate);
+		printf("%s writebacks: %ld back-invalidations: %ld\n", l->name, c->writebacks,
+			l->back_invalidations);
+	}
+	printf("Memory: %d cycles, reads: %ld writes: %ld\n", h->memory_latency, h->memory_reads,
+		h->memory_writes);
+	printf("AMAT: %.2f cycles\n", hierarchy_amat(h));
+}
+// ============================================================================
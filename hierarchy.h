@@ -0,0 +1,46 @@
+/**
+ * hierarchy.h - Multi-level cache hierarchy for cachesimplus
+ * A chain of tag-only caches read from a config file, where the misses of
+ * one level are looked up in the next and the last level misses to memory
+ **/
+
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include "cache.h"
+
+#define HIER_MAX_LEVELS 8
+#define HIER_NAME_LEN 16
+
+// How a level relates to the levels above it
+#define HIER_NINE 0       // neither inclusive nor exclusive
+#define HIER_INCLUSIVE 1  // holds everything above it, evictions back-invalidate
+#define HIER_EXCLUSIVE 2  // holds only victims from above, hits move up
+
+typedef struct hier_level {
+	char name[HIER_NAME_LEN];
+	cache* c;             // tag-only; hits/misses count lookups at this level
+	int latency;          // cycles for a hit
+	int inclusion;        // HIER_*
+	long back_invalidations;
+} hier_level;
+
+typedef struct hierarchy {
+	int nlevels;
+	hier_level levels[HIER_MAX_LEVELS]; // [0] is closest to the core
+	int memory_latency;
+	long memory_reads;
+	long memory_writes;
+	int served;           // deepest level the last access was served from, nlevels for memory
+} hierarchy;
+
+// Signatures =================================================================
+hierarchy* load_hierarchy(const char* fileName, unsigned int seed);
+void destroy_hierarchy(hierarchy* h);
+int hierarchy_access(hierarchy* h, int address, int size, int is_store);
+double hierarchy_amat(const hierarchy* h);
+int hierarchy_miss_latency(const hierarchy* h, int level);
+void print_hierarchy_stats(const hierarchy* h);
+// ============================================================================
+
+#endif
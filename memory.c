@@ -4,6 +4,11 @@
  * 
  * Author: Anshu Dwibhashi
  * Last Updated: 27th Oct, 2020
+ *
+ * Memory is sparse: a two-level page map covering the full 32-bit address
+ * space, with each MEM_PAGE_SIZE page allocated (zeroed) the first time it
+ * is written. Reads of untouched memory return zeros without allocating.
+ * Checkpoints hold only the pages with a nonzero byte in them.
  **/
 
 #include <stdlib.h>
@@ -11,21 +16,51 @@
 #include <string.h>
 #include "memory.h"
 
-unsigned char* memory __attribute__ ((visibility ("hidden")));
-int read_calls __attribute__ ((visibility ("hidden")));
-int write_calls __attribute__ ((visibility ("hidden")));
-int bytes_read __attribute__ ((visibility ("hidden")));
-int bytes_written __attribute__ ((visibility ("hidden")));
+#define MEM_PAGE_BITS 12
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_BITS)
+#define MEM_L2_BITS 10
+#define MEM_L1_BITS (32 - MEM_PAGE_BITS - MEM_L2_BITS)
+
+unsigned char** memory[1 << MEM_L1_BITS] __attribute__ ((visibility ("hidden")));
+long read_calls __attribute__ ((visibility ("hidden")));
+long write_calls __attribute__ ((visibility ("hidden")));
+long bytes_read __attribute__ ((visibility ("hidden")));
+long bytes_written __attribute__ ((visibility ("hidden")));
 
 
 // Definitions ================================================================
 void init_memory() {
-	memory = (unsigned char*) malloc(16777216 * sizeof(unsigned char)); // 16 M
-	memset(memory, 0, 16777216);
+	memset(memory, 0, sizeof(memory));
 }
 
 void destroy_memory() {
-	free(memory);
+	for (int i = 0; i < (1 << MEM_L1_BITS); i++) {
+		if (memory[i] == NULL) {
+			continue;
+		}
+		for (int j = 0; j < (1 << MEM_L2_BITS); j++) {
+			free(memory[i][j]);
+		}
+		free(memory[i]);
+		memory[i] = NULL;
+	}
+}
+
+/**
+ * Returns the page holding "address", or NULL if it was never written and
+ * "allocate" is 0
+ */
+static unsigned char* memory_page(unsigned int address, int allocate) {
+	unsigned int l1 = address >> (MEM_PAGE_BITS + MEM_L2_BITS);
+	unsigned int l2 = (address >> MEM_PAGE_BITS) & ((1 << MEM_L2_BITS) - 1);
+	if (memory[l1] == NULL) {
+		if (!allocate) return NULL;
+		memory[l1] = (unsigned char**) calloc(1 << MEM_L2_BITS, sizeof(unsigned char*));
+	}
+	if (memory[l1][l2] == NULL && allocate) {
+		memory[l1][l2] = (unsigned char*) calloc(MEM_PAGE_SIZE, sizeof(unsigned char));
+	}
+	return memory[l1][l2];
 }
 
 /**
@@ -33,8 +68,22 @@ void destroy_memory() {
  * the result in buffer
  */
 void read_from_memory(unsigned char* buffer, int address, int num_bytes) {
-	for(int i = 0; i < num_bytes; i++){
-		*(buffer + i) = *(memory + address + i);
+	unsigned int addr = (unsigned int) address;
+	int done = 0;
+	while (done < num_bytes) {
+		int offset = addr & (MEM_PAGE_SIZE - 1);
+		int chunk = MEM_PAGE_SIZE - offset;
+		if (chunk > num_bytes - done) chunk = num_bytes - done;
+
+		unsigned char* page = memory_page(addr, 0);
+		if (page != NULL) {
+			memcpy(buffer + done, page + offset, chunk);
+		}
+		else {
+			memset(buffer + done, 0, chunk);
+		}
+		done += chunk;
+		addr += chunk;
 	}
 
 	read_calls++;
@@ -42,11 +91,88 @@ void read_from_memory(unsigned char* buffer, int address, int num_bytes) {
 }
 
 void write_to_memory(unsigned char* buffer, int address, int num_bytes) {
-	for(int i = 0; i < num_bytes; i++){
-		*(memory + address + i) = *(buffer + i);
+	unsigned int addr = (unsigned int) address;
+	int done = 0;
+	while (done < num_bytes) {
+		int offset = addr & (MEM_PAGE_SIZE - 1);
+		int chunk = MEM_PAGE_SIZE - offset;
+		if (chunk > num_bytes - done) chunk = num_bytes - done;
+
+		memcpy(memory_page(addr, 1) + offset, buffer + done, chunk);
+		done += chunk;
+		addr += chunk;
 	}
 	write_calls++;
 	bytes_written += num_bytes;
 }
-// ============================================================================
 
+void get_memory_counters(memory_counters* counters) {
+	counters->read_calls = read_calls;
+	counters->write_calls = write_calls;
+	counters->bytes_read = bytes_read;
+	counters->bytes_written = bytes_written;
+}
+
+static int page_is_zero(const unsigned char* page) {
+	for (int i = 0; i < MEM_PAGE_SIZE; i++) {
+		if (page[i] != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Writes the traffic counters, the number of nonzero pages and then each
+ * of them (page number, MEM_PAGE_SIZE bytes) to "f".
+ * Returns 0, or -1 if writing failed.
+ */
+int save_memory(FILE* f) {
+	long header[5] = {read_calls, write_calls, bytes_read, bytes_written, 0};
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1 && fwrite(header, sizeof(header), 1, f) != 1) {
+			return -1;
+		}
+		for (unsigned int i = 0; i < (1u << MEM_L1_BITS); i++) {
+			for (unsigned int j = 0; memory[i] != NULL && j < (1u << MEM_L2_BITS); j++) {
+				unsigned char* page = memory[i][j];
+				if (page == NULL || page_is_zero(page)) {
+					continue;
+				}
+				unsigned int number = (i << MEM_L2_BITS) | j;
+				if (pass == 0) {
+					header[4]++;
+				}
+				else if (fwrite(&number, sizeof(number), 1, f) != 1 || fwrite(page, MEM_PAGE_SIZE, 1, f) != 1) {
+					return -1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+ * Replaces memory and its counters with what save_memory() wrote to "f".
+ * Returns 0, or -1 if the data is cut short.
+ */
+int restore_memory(FILE* f) {
+	long header[5];
+	if (fread(header, sizeof(header), 1, f) != 1 || header[4] < 0) {
+		return -1;
+	}
+	destroy_memory();
+	read_calls = header[0];
+	write_calls = header[1];
+	bytes_read = header[2];
+	bytes_written = header[3];
+	for (long k = 0; k < header[4]; k++) {
+		unsigned int number;
+		if (fread(&number, sizeof(number), 1, f) != 1 || (number >> (MEM_L1_BITS + MEM_L2_BITS)) != 0
+				|| fread(memory_page(number << MEM_PAGE_BITS, 1), MEM_PAGE_SIZE, 1, f) != 1) {
+			return -1;
+		}
+	}
+	return 0;
+}
+// ============================================================================
@@ -6,10 +6,28 @@
  * Last Updated: 27th Oct, 2020
  **/
 
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdio.h>
+
+// Traffic seen by read_from_memory() and write_to_memory() so far
+typedef struct memory_counters {
+	long read_calls;
+	long write_calls;
+	long bytes_read;
+	long bytes_written;
+} memory_counters;
+
 // Signatures =================================================================
 void init_memory();
 void destroy_memory();
 void read_from_memory(unsigned char*, int, int);
 void write_to_memory(unsigned char*, int, int);
+void get_memory_counters(memory_counters*);
+int save_memory(FILE*);
+int restore_memory(FILE*);
 // ============================================================================
 
+#endif
+
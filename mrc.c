@@ -0,0 +1,325 @@
+/**
+ * mrc.c - Stack-distance (Mattson) analysis for cachesimplus
+ * One pass over the trace gives the fully-associative LRU miss ratio at
+ * every capacity for a given block size
+ *
+ * A block's stack distance is the number of other blocks touched since its
+ * last access; an LRU cache of C blocks hits exactly when that is below C.
+ * Each block's latest access is marked in a Fenwick tree indexed by time,
+ * so the distance is a prefix count. Time slots are renumbered whenever
+ * the tree fills up, keeping it at most twice the number of distinct
+ * blocks: O(N log M) for N accesses to M blocks.
+ *
+ * Below a sampling rate of 1 this is SHARDS: only blocks whose hash falls
+ * under the rate are analysed, and a distance measured among them stands
+ * for distance / rate blocks of the full trace. Most accesses then cost a
+ * hash and a compare.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "mrc.h"
+
+#define MRC_MIN_TREE 1024
+
+// Definitions ================================================================
+mrc* create_mrc(int block_size, double rate) {
+	if (block_size < 1 || rate <= 0.0) {
+		return NULL;
+	}
+	mrc* m = (mrc*) calloc(1, sizeof(mrc));
+	m->block_size = block_size;
+	m->rate = (rate < 1.0) ? rate : 1.0;
+	m->threshold = sample_threshold(m->rate);
+	int n = block_size;
+	while (n >>= 1) m->bbits++;
+
+	m->hist_len = 16;
+	m->hist = (long*) calloc(m->hist_len, sizeof(long));
+	m->map_cap = 16;
+	m->keys = (long*) malloc(m->map_cap * sizeof(long));
+	m->last = (long*) malloc(m->map_cap * sizeof(long));
+	for (long i = 0; i < m->map_cap; i++) {
+		m->keys[i] = -1;
+	}
+	m->tree_cap = MRC_MIN_TREE;
+	m->tree = (int*) calloc(m->tree_cap + 1, sizeof(int));
+	m->owner = (long*) malloc(m->tree_cap * sizeof(long));
+	return m;
+}
+
+void destroy_mrc(mrc* m) {
+	if (m == NULL) {
+		return;
+	}
+	free(m->hist);
+	free(m->keys);
+	free(m->last);
+	free(m->tree);
+	free(m->owner);
+	free(m);
+}
+
+static void tree_add(mrc* m, long slot, int delta) {
+	for (long i = slot + 1; i <= m->tree_cap; i += i & -i) {
+		m->tree[i] += delta;
+	}
+}
+
+// Marked time slots at or before "slot"
+static long tree_prefix(const mrc* m, long slot) {
+	long sum = 0;
+	for (long i = slot + 1; i > 0; i -= i & -i) {
+		sum += m->tree[i];
+	}
+	return sum;
+}
+
+static long find_slot(const long* keys, long cap, long block) {
+	unsigned long h = ((unsigned long) block * 0x9E3779B97F4A7C15ul) & (cap - 1);
+	while (keys[h] != -1 && keys[h] != block) {
+		h = (h + 1) & (cap - 1);
+	}
+	return h;
+}
+
+// Doubles the block map; slots move, so the time slot owners follow them
+static void grow_map(mrc* m) {
+	long cap = m->map_cap * 2;
+	long* keys = (long*) malloc(cap * sizeof(long));
+	long* last = (long*) malloc(cap * sizeof(long));
+	for (long i = 0; i < cap; i++) {
+		keys[i] = -1;
+	}
+	for (long i = 0; i < m->map_cap; i++) {
+		if (m->keys[i] != -1) {
+			long h = find_slot(keys, cap, m->keys[i]);
+			keys[h] = m->keys[i];
+			last[h] = m->last[i];
+			m->owner[last[h]] = h;
+		}
+	}
+	free(m->keys);
+	free(m->last);
+	m->keys = keys;
+	m->last = last;
+	m->map_cap = cap;
+}
+
+/**
+ * Renumbers the marked time slots 0..distinct-1, keeping their order, into
+ * a tree sized for twice the distinct blocks, and rebuilds it in O(size).
+ */
+static void compact_time(mrc* m) {
+	long cap = 2 * m->distinct;
+	if (cap < MRC_MIN_TREE) cap = MRC_MIN_TREE;
+	long* owner = (long*) malloc(cap * sizeof(long));
+	long n = 0;
+	for (long t = 0; t < m->now; t++) {
+		if (m->owner[t] >= 0) {
+			owner[n] = m->owner[t];
+			m->last[owner[n]] = n;
+			n++;
+		}
+	}
+
+	free(m->tree);
+	m->tree = (int*) calloc(cap + 1, sizeof(int));
+	for (long i = 1; i <= cap; i++) {
+		if (i <= n) m->tree[i] += 1;
+		long parent = i + (i & -i);
+		if (parent <= cap) {
+			m->tree[parent] += m->tree[i];
+		}
+	}
+	free(m->owner);
+	m->owner = owner;
+	m->tree_cap = cap;
+	m->now = n;
+}
+
+/**
+ * Records one access to physical "address". Returns its stack distance
+ * (scaled up for a sampled curve), MRC_COLD for a first touch or
+ * MRC_SKIPPED for a block outside the sample.
+ */
+long mrc_access(mrc* m, unsigned int address) {
+	long block = (long) (address >> m->bbits);
+	m->seen++;
+	int unit = 0;
+	if (m->rate < 1.0) {
+		unsigned long long hash = sample_hash(block);
+		if (!sample_selected(hash, m->threshold)) {
+			return MRC_SKIPPED;
+		}
+		unit = sample_unit(hash);
+	}
+	if (m->now == m->tree_cap) {
+		compact_time(m);
+	}
+	m->accesses++;
+
+	long h = find_slot(m->keys, m->map_cap, block);
+	long distance = MRC_COLD;
+	if (m->keys[h] == -1) {
+		m->cold++;
+		m->keys[h] = block;
+		m->distinct++;
+		m->unit_bins[unit][MRC_BINS - 1]++;
+	}
+	else {
+		long prev = m->last[h];
+		// every other marked slot after prev is a block touched since
+		long d = m->distinct - tree_prefix(m, prev);
+		if (m->rate < 1.0) {
+			d = (long) (d / m->rate);
+			int bin = 0;
+			while (bin < MRC_BINS - 2 && (d >> bin) > 0) bin++;
+			m->unit_bins[unit][bin]++;
+		}
+		if (d >= m->hist_len) {
+			long len = m->hist_len;
+			while (len <= d) len *= 2;
+			m->hist = (long*) realloc(m->hist, len * sizeof(long));
+			memset(m->hist + m->hist_len, 0, (len - m->hist_len) * sizeof(long));
+			m->hist_len = len;
+		}
+		m->hist[d]++;
+		distance = d;
+		tree_add(m, prev, -1);
+		m->owner[prev] = -1;
+	}
+
+	m->last[h] = m->now;
+	m->owner[m->now] = h;
+	tree_add(m, m->now, 1);
+	m->now++;
+
+	if (2 * m->distinct > m->map_cap) {
+		grow_map(m);
+	}
+	return distance;
+}
+
+/**
+ * Records an access of "size" bytes at "address" as one access to each
+ * block it touches. Returns MRC_COLD if any block was touched for the
+ * first time, else the largest distance (MRC_SKIPPED if none was sampled),
+ * i.e. what decides whether the whole access hits.
+ */
+long mrc_access_range(mrc* m, unsigned int address, int size) {
+	unsigned int first = address >> m->bbits;
+	unsigned int last = (address + (unsigned int) size - 1) >> m->bbits;
+	long result = MRC_SKIPPED;
+	for (unsigned int b = first; ; b++) {
+		long d = mrc_access(m, b << m->bbits);
+		if (result != MRC_COLD && (d == MRC_COLD || d > result)) {
+			result = d;
+		}
+		if (b == last) break;
+	}
+	return result;
+}
+
+/**
+ * Misses a fully-associative LRU cache of "capacity" blocks would take.
+ */
+long mrc_misses(const mrc* m, long capacity) {
+	long misses = m->cold;
+	for (long d = capacity; d < m->hist_len; d++) {
+		misses += m->hist[d];
+	}
+	return misses;
+}
+
+/**
+ * Standard error of the miss ratio at "capacity" (a power of two) blocks
+ * for a sampled curve, from how it varies between sample units. 0 for an
+ * exact curve.
+ */
+double mrc_error(const mrc* m, long capacity) {
+	if (m->rate >= 1.0) {
+		return 0.0;
+	}
+	// distances of at least capacity = 2^k sit in bins k + 1 and up
+	int first = 1;
+	while (first < MRC_BINS - 1 && (1L << (first - 1)) < capacity) first++;
+	long accesses[SAMPLE_UNITS], misses[SAMPLE_UNITS];
+	for (int u = 0; u < SAMPLE_UNITS; u++) {
+		accesses[u] = 0;
+		misses[u] = 0;
+		for (int b = 0; b < MRC_BINS; b++) {
+			accesses[u] += m->unit_bins[u][b];
+			if (b >= first) misses[u] += m->unit_bins[u][b];
+		}
+	}
+	return sample_error(accesses, misses, m->rate);
+}
+
+/**
+ * Prints each curve at power-of-two capacities, from one block up to the
+ * first capacity holding every block (where only cold misses remain), as
+ * CSV with a header line or as a JSON document. Sampled curves scale
+ * misses to the whole trace and add the miss ratio's standard error.
+ */
+void print_mrc(mrc* const* curves, int count, int json) {
+	int sampled = 0;
+	for (int i = 0; i < count; i++) {
+		sampled |= (curves[i]->rate < 1.0);
+	}
+	if (json) {
+		printf("{\"curves\": [\n");
+	}
+	else {
+		printf("block_size,capacity_blocks,capacity_bytes,accesses,misses,miss_ratio%s\n",
+			sampled ? ",miss_ratio_error" : "");
+	}
+	for (int i = 0; i < count; i++) {
+		const mrc* m = curves[i];
+		if (json) {
+			printf("  {\"block_size\": %d, \"accesses\": %ld, \"cold_misses\": %ld, ",
+				m->block_size, m->seen, (long) (m->cold / m->rate + 0.5));
+			if (sampled) {
+				printf("\"sample_rate\": %g, \"sampled_accesses\": %ld, ", m->rate, m->accesses);
+			}
+			printf("\"points\": [\n");
+		}
+		// misses for every capacity come from one running suffix sum
+		long misses = mrc_misses(m, 1);
+		long d = 1;
+		double footprint = m->distinct / m->rate;
+		for (long capacity = 1; ; capacity *= 2) {
+			for (; d < capacity && d < m->hist_len; d++) {
+				misses -= m->hist[d];
+			}
+			double ratio = m->accesses ? (double) misses / m->accesses : 0.0;
+			long scaled = (m->rate < 1.0) ? (long) (ratio * m->seen + 0.5) : misses;
+			int done = capacity >= footprint;
+			if (json) {
+				printf("    {\"capacity_blocks\": %ld, \"capacity_bytes\": %ld, \"misses\": %ld, "
+					"\"miss_ratio\": %.6f", capacity, capacity * m->block_size, scaled, ratio);
+				if (sampled) {
+					printf(", \"miss_ratio_error\": %.6f", mrc_error(m, capacity));
+				}
+				printf("}%s\n", done ? "" : ",");
+			}
+			else {
+				printf("%d,%ld,%ld,%ld,%ld,%.6f", m->block_size, capacity,
+					capacity * m->block_size, m->seen, scaled, ratio);
+				if (sampled) {
+					printf(",%.6f", mrc_error(m, capacity));
+				}
+				printf("\n");
+			}
+			if (done) break;
+		}
+		if (json) {
+			printf("  ]}%s\n", (i + 1 < count) ? "," : "");
+		}
+	}
+	if (json) {
+		printf("]}\n");
+	}
+}
+// ============================================================================
@@ -0,0 +1,51 @@
+/**
+ * mrc.h - Stack-distance (Mattson) analysis for cachesimplus
+ * One pass over the trace gives the fully-associative LRU miss ratio at
+ * every capacity for a given block size
+ **/
+
+#ifndef MRC_H
+#define MRC_H
+
+#include "sample.h"
+
+// Capacities reported are powers of two; bin 0 holds distance 0, bin b
+// distances [2^(b-1), 2^b), MRC_BINS - 1 first touches
+#define MRC_BINS 66
+
+// mrc_access() results other than a stack distance
+#define MRC_COLD (-1)        // first touch of the block
+#define MRC_SKIPPED (-2)     // block not in the sample
+
+typedef struct mrc {
+	int block_size;
+	int bbits;            // log2(block_size)
+	double rate;          // fraction of blocks analysed, 1 for all of them
+	unsigned long long threshold;
+	long seen;            // every access, sampled or not
+	long accesses;        // sampled accesses
+	long cold;            // first touches, misses at any capacity
+	long* hist;           // [hist_len], hist[d]: reuses with d other blocks in between
+	long hist_len;
+	long* keys;           // [map_cap], block addresses, -1 for an empty slot
+	long* last;           // [map_cap], time slot of the block's latest access
+	long map_cap;
+	long distinct;        // blocks seen so far
+	int* tree;            // [tree_cap + 1], Fenwick tree marking latest accesses
+	long* owner;          // [tree_cap], map slot whose latest access is at a time slot, or -1
+	long tree_cap;
+	long now;             // next time slot
+	long unit_bins[SAMPLE_UNITS][MRC_BINS]; // sampled runs only, for the error estimate
+} mrc;
+
+// Signatures =================================================================
+mrc* create_mrc(int block_size, double rate);
+void destroy_mrc(mrc* m);
+long mrc_access(mrc* m, unsigned int address);
+long mrc_access_range(mrc* m, unsigned int address, int size);
+long mrc_misses(const mrc* m, long capacity);
+double mrc_error(const mrc* m, long capacity);
+void print_mrc(mrc* const* curves, int count, int json);
+// ============================================================================
+
+#endif
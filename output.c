@@ -0,0 +1,123 @@
+/**
+ * output.c - Buffered writer for cachesimplus' per-access output
+ * Formats "load 0x... hit <hex>" / "store 0x... miss" lines into one large
+ * buffer and hands it to write() in big pieces
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "output.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Two lowercase hex characters for every byte value
+static char hex_pairs[256][2];
+
+// Definitions ================================================================
+output_writer* create_writer(int fd) {
+	if (hex_pairs[1][1] != '1') {
+		for (int i = 0; i < 256; i++) {
+			hex_pairs[i][0] = hex_digits[i >> 4];
+			hex_pairs[i][1] = hex_digits[i & 0xf];
+		}
+	}
+
+	output_writer* w = (output_writer*) malloc(sizeof(output_writer));
+	w->fd = fd;
+	w->buf = (char*) malloc(OUTPUT_BUFFER_SIZE);
+	w->len = 0;
+	return w;
+}
+
+void destroy_writer(output_writer* w) {
+	if (w == NULL) {
+		return;
+	}
+	flush_writer(w);
+	free(w->buf);
+	free(w);
+}
+
+void flush_writer(output_writer* w) {
+	size_t done = 0;
+	while (done < w->len) {
+		ssize_t n = write(w->fd, w->buf + done, w->len - done);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		done += n;
+	}
+	w->len = 0;
+}
+
+// Makes sure "need" more bytes fit, flushing if they don't
+static char* reserve(output_writer* w, size_t need) {
+	if (w->len + need > OUTPUT_BUFFER_SIZE) {
+		flush_writer(w);
+	}
+	return w->buf + w->len;
+}
+
+// "0x" and the address in hex without leading zeros, like printf's %x
+static char* put_address(char* p, unsigned long long address) {
+	*p++ = '0';
+	*p++ = 'x';
+	int shift = (address >> 32) ? 44 : 28;
+	while (shift > 0 && ((address >> shift) & 0xf) == 0) {
+		shift -= 4;
+	}
+	for (; shift >= 0; shift -= 4) {
+		*p++ = hex_digits[(address >> shift) & 0xf];
+	}
+	return p;
+}
+
+void write_load(output_writer* w, unsigned long long address, int hit, const unsigned char* data, int size) {
+	// "load 0x" + 12 digits + " miss " + data + "\n"
+	char* start = reserve(w, 28 + 2 * (size_t) size);
+	char* p = start;
+	memcpy(p, "load ", 5);
+	p = put_address(p + 5, address);
+	if (hit) {
+		memcpy(p, " hit ", 5);
+		p += 5;
+	}
+	else {
+		memcpy(p, " miss ", 6);
+		p += 6;
+	}
+	for (int i = 0; i < size; i++) {
+		memcpy(p, hex_pairs[data[i]], 2);
+		p += 2;
+	}
+	*p++ = '\n';
+	w->len += p - start;
+}
+
+void write_store(output_writer* w, unsigned long long address, int hit) {
+	char* start = reserve(w, 28);
+	char* p = start;
+	memcpy(p, "store ", 6);
+	p = put_address(p + 6, address);
+	if (hit) {
+		memcpy(p, " hit\n", 5);
+		p += 5;
+	}
+	else {
+		memcpy(p, " miss\n", 6);
+		p += 6;
+	}
+	w->len += p - start;
+}
+
+void write_pagefault(output_writer* w) {
+	char* p = reserve(w, 10);
+	memcpy(p, "PAGEFAULT\n", 10);
+	w->len += 10;
+}
+// ============================================================================
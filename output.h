@@ -0,0 +1,29 @@
+/**
+ * output.h - Buffered writer for cachesimplus' per-access output
+ * Formats "load 0x... hit <hex>" / "store 0x... miss" lines into one large
+ * buffer and hands it to write() in big pieces
+ **/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+typedef struct output_writer {
+	int fd;
+	char* buf;
+	size_t len;
+} output_writer;
+
+// Signatures =================================================================
+output_writer* create_writer(int fd);
+void destroy_writer(output_writer* w);
+void flush_writer(output_writer* w);
+void write_load(output_writer* w, unsigned long long address, int hit, const unsigned char* data, int size);
+void write_store(output_writer* w, unsigned long long address, int hit);
+void write_pagefault(output_writer* w);
+// ============================================================================
+
+#endif
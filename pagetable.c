@@ -0,0 +1,247 @@
+/**
+ * pagetable.c - In-memory page table for cachesimplus and virt2phys
+ * Parses a page table file once and translates virtual addresses, either
+ * in O(1) from a flat table or by walking an x86-64 style radix table
+ *
+ * Flat format: address bits, page size, then one PPN per VPN in order
+ * (-1 for an invalid page).
+ *
+ * Radix format: "radix <address bits> [table base]", then one mapping per
+ * line, "<va> <pa>" for a 4kB page or "huge <va> <pa>" for a 2MB one, all
+ * in hex and aligned to the page. '#' starts a comment. The address space
+ * may be 22 to 48 bits wide; physical addresses stay below 2GB. Only the
+ * nodes the mappings need are built, so a sparse 48-bit space is cheap.
+ * Node i sits at physical address table base + i * 4kB (RADIX_TABLE_BASE
+ * by default), which is what a walk reads when it reads one of its entries.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "pagetable.h"
+
+// Definitions ================================================================
+// Depth "depth"'s index in "va" starts at this bit
+int radix_shift(const page_table* pt, int depth) {
+	return RADIX_PAGE_BITS + RADIX_LEVEL_BITS * (pt->levels - 1 - depth);
+}
+
+static int node_of(const page_table* pt, unsigned long long entry) {
+	return (int) (((entry & PTE_ADDR_MASK) - (unsigned long long) pt->table_base) >> RADIX_PAGE_BITS);
+}
+
+// Appends an empty node, doubling the array whenever its size reaches a
+// power of two. Returns its index, or -1 if it wouldn't fit below 2GB.
+static int add_node(page_table* pt) {
+	int n = pt->num_nodes;
+	if ((long long) pt->table_base + (((long long) n + 1) << RADIX_PAGE_BITS) > 0x80000000ll) {
+		return -1;
+	}
+	if ((n & (n - 1)) == 0) {
+		size_t grown = (n ? 2 * (size_t) n : 1) * RADIX_ENTRIES;
+		pt->nodes = (unsigned long long*) realloc(pt->nodes, grown * sizeof(unsigned long long));
+	}
+	memset(&pt->nodes[(size_t) n * RADIX_ENTRIES], 0, RADIX_ENTRIES * sizeof(unsigned long long));
+	pt->num_nodes++;
+	return n;
+}
+
+// Maps the page at "va" to "pa", building nodes on the way down.
+// Returns 0, or -1 if the page overlaps one already mapped.
+static int map_page(page_table* pt, unsigned long long va, unsigned long long pa, int huge) {
+	int leaf = huge ? pt->levels - 2 : pt->levels - 1;
+	int node = 0;
+	for (int d = 0; d < leaf; d++) {
+		size_t slot = (size_t) node * RADIX_ENTRIES + ((va >> radix_shift(pt, d)) & (RADIX_ENTRIES - 1));
+		if (!(pt->nodes[slot] & PTE_PRESENT)) {
+			int child = add_node(pt);
+			if (child < 0) {
+				return -1;
+			}
+			pt->nodes[slot] = ((unsigned long long) pt->table_base + ((unsigned long long) child << RADIX_PAGE_BITS))
+				| PTE_PRESENT;
+		}
+		else if (pt->nodes[slot] & PTE_HUGE) {
+			return -1;
+		}
+		node = node_of(pt, pt->nodes[slot]);
+	}
+	size_t slot = (size_t) node * RADIX_ENTRIES + ((va >> radix_shift(pt, leaf)) & (RADIX_ENTRIES - 1));
+	if (pt->nodes[slot] & PTE_PRESENT) {
+		return -1;
+	}
+	pt->nodes[slot] = pa | PTE_PRESENT | (huge ? PTE_HUGE : 0);
+	pt->huge_pages += huge;
+	return 0;
+}
+
+/**
+ * Reads the rest of a radix page table file, the "radix" already consumed.
+ * Returns 0, or -1 after saying what's wrong with the file.
+ */
+static int load_radix(FILE* f, const char* fileName, page_table* pt) {
+	char line[256];
+	unsigned long base = RADIX_TABLE_BASE;
+	if (fgets(line, sizeof(line), f) == NULL || sscanf(line, "%d %lx", &pt->addr_bits, &base) < 1
+			|| pt->addr_bits < RADIX_HUGE_BITS + 1 || pt->addr_bits > 48
+			|| (base & ((1 << RADIX_PAGE_BITS) - 1)) != 0 || base >= 0x80000000ul) {
+		fprintf(stderr, "%s:1: expecting \"radix <22-48 address bits> [4kB-aligned table base]\"\n", fileName);
+		return -1;
+	}
+	pt->page_size = 1 << RADIX_PAGE_BITS;
+	pt->offset_bits = RADIX_PAGE_BITS;
+	pt->levels = (pt->addr_bits - RADIX_PAGE_BITS + RADIX_LEVEL_BITS - 1) / RADIX_LEVEL_BITS;
+	pt->table_base = (int) base;
+	add_node(pt);
+
+	int lineNum = 1;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineNum++;
+		char* comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		char first[24];
+		unsigned long long va, pa;
+		int huge = 0;
+		int fields = sscanf(line, "%23s %llx %llx", first, &va, &pa);
+		if (fields < 1) {
+			continue;
+		}
+		if (strcmp(first, "huge") == 0) {
+			huge = 1;
+		}
+		else {
+			pa = va;
+			fields = (sscanf(first, "%llx", &va) == 1) ? fields + 1 : 0;
+		}
+		unsigned long long mask = (1ull << (huge ? RADIX_HUGE_BITS : RADIX_PAGE_BITS)) - 1;
+		if (fields != 3 || (va & mask) != 0 || (pa & mask) != 0 || (va >> pt->addr_bits) != 0
+				|| pa >= 0x80000000ull) {
+			fprintf(stderr, "%s:%d: expecting \"[huge] <va> <pa>\", page aligned and in range\n",
+				fileName, lineNum);
+			return -1;
+		}
+		if (map_page(pt, va, pa, huge) != 0) {
+			fprintf(stderr, "%s:%d: page overlaps an earlier mapping or the table is full\n", fileName, lineNum);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Reads the whole page table in "fileName": a flat one into a dense
+ * VPN -> PPN array, a radix one into its nodes. Entries missing from the
+ * end of a flat table are treated as invalid.
+ * Returns NULL if the file can't be opened or is malformed.
+ */
+page_table* load_page_table(const char* fileName) {
+	FILE* f = fopen(fileName, "r");
+	if (f == NULL) {
+		return NULL;
+	}
+
+	page_table* pt = (page_table*) calloc(1, sizeof(page_table));
+	char first[8];
+	if (fscanf(f, "%7s", first) == 1 && strcmp(first, "radix") == 0) {
+		int status = load_radix(f, fileName, pt);
+		fclose(f);
+		if (status != 0) {
+			destroy_page_table(pt);
+			return NULL;
+		}
+		return pt;
+	}
+	rewind(f);
+
+	if (fscanf(f, "%d", &pt->addr_bits) != 1 || fscanf(f, "%d", &pt->page_size) != 1
+			|| pt->page_size < 1 || pt->addr_bits < 1 || pt->addr_bits > 31) {
+		fclose(f);
+		free(pt);
+		return NULL;
+	}
+
+	int n = pt->page_size;
+	int r = 0;
+	while (n >>= 1) r++;
+	pt->offset_bits = r;
+
+	pt->num_pages = (pt->addr_bits > r) ? 1 << (pt->addr_bits - r) : 1;
+	pt->ppn = (int*) malloc(pt->num_pages * sizeof(int));
+
+	// Entries are read as tokens and converted with atoi() so that a stray
+	// suffix (e.g. "4d" in pagetable-8c.txt) doesn't end the table early
+	int i = 0;
+	char entry[24];
+	while (i < pt->num_pages && fscanf(f, "%23s", entry) == 1) {
+		pt->ppn[i] = atoi(entry);
+		i++;
+	}
+	for (; i < pt->num_pages; i++) {
+		pt->ppn[i] = -1;
+	}
+
+	fclose(f);
+	return pt;
+}
+
+void destroy_page_table(page_table* pt) {
+	if (pt == NULL) {
+		return;
+	}
+	free(pt->ppn);
+	free(pt->nodes);
+	free(pt);
+}
+
+/**
+ * Walks a radix table for "va", starting at node "node" of depth "depth"
+ * (0 and 0 from the root), and records every entry read in "w".
+ * Returns the physical address, or PAGEFAULT_ADDR if an entry on the way
+ * isn't present or "va" is outside the address space.
+ */
+int walk_page_table(const page_table* pt, unsigned long long va, int depth, int node, page_walk* w) {
+	w->nrefs = 0;
+	w->huge = 0;
+	w->depth = depth;
+	if ((va >> pt->addr_bits) != 0) {
+		return PAGEFAULT_ADDR;
+	}
+	for (int d = depth; d < pt->levels; d++) {
+		int index = (int) ((va >> radix_shift(pt, d)) & (RADIX_ENTRIES - 1));
+		unsigned long long entry = pt->nodes[(size_t) node * RADIX_ENTRIES + index];
+		w->path[d] = node;
+		w->refs[w->nrefs++] = pt->table_base + (node << RADIX_PAGE_BITS) + index * RADIX_PTE_SIZE;
+		w->depth = d;
+		if (!(entry & PTE_PRESENT)) {
+			return PAGEFAULT_ADDR;
+		}
+		if (d == pt->levels - 1 || (entry & PTE_HUGE)) {
+			w->huge = (entry & PTE_HUGE) != 0;
+			unsigned long long offset = va & ((1ull << (w->huge ? RADIX_HUGE_BITS : RADIX_PAGE_BITS)) - 1);
+			return (int) ((entry & PTE_ADDR_MASK) | offset);
+		}
+		node = node_of(pt, entry);
+	}
+	return PAGEFAULT_ADDR;
+}
+
+/**
+ * Translates virtual address "va" to a physical address.
+ * Returns PAGEFAULT_ADDR if the page is invalid or outside the table.
+ */
+int translate_address(const page_table* pt, unsigned long long va) {
+	if (pt->levels > 0) {
+		page_walk w;
+		return walk_page_table(pt, va, 0, 0, &w);
+	}
+	unsigned long long vpn = va >> pt->offset_bits;
+	int offset = (int) (va & ((1u << pt->offset_bits) - 1));
+
+	if (vpn >= (unsigned long long) pt->num_pages || pt->ppn[vpn] < 0) {
+		return PAGEFAULT_ADDR;
+	}
+	return (pt->ppn[vpn] << pt->offset_bits) | offset;
+}
+// ============================================================================
@@ -0,0 +1,58 @@
+/**
+ * pagetable.h - In-memory page table for cachesimplus and virt2phys
+ * Parses a page table file once and translates virtual addresses, either
+ * in O(1) from a flat table or by walking an x86-64 style radix table
+ **/
+
+#ifndef PAGETABLE_H
+#define PAGETABLE_H
+
+#define PAGEFAULT_ADDR (-1)
+
+// Radix tables: 4kB nodes of 512 8-byte entries, one level per 9 bits of
+// virtual page number, so 48-bit addresses take 4 levels and 32-bit ones 3
+#define RADIX_PAGE_BITS 12
+#define RADIX_LEVEL_BITS 9
+#define RADIX_ENTRIES (1 << RADIX_LEVEL_BITS)
+#define RADIX_PTE_SIZE 8
+#define RADIX_MAX_LEVELS 4
+#define RADIX_HUGE_BITS (RADIX_PAGE_BITS + RADIX_LEVEL_BITS) // 2MB pages
+#define RADIX_TABLE_BASE 0x70000000 // physical address of the root by default
+
+// Entry bits, as in x86-64: present, page size (a huge page, not a table)
+// and the physical address of the page or next node in bits 12 and up
+#define PTE_PRESENT 0x1ull
+#define PTE_HUGE 0x80ull
+#define PTE_ADDR_MASK 0x000ffffffffff000ull
+
+typedef struct page_table {
+	int addr_bits;   // width of the virtual address space
+	int page_size;   // bytes per page
+	int offset_bits; // log2(page_size)
+	int num_pages;   // flat tables: 2^(addr_bits - offset_bits) entries in ppn
+	int* ppn;        // flat tables: VPN -> PPN, -1 marks an invalid page
+	int levels;      // radix tables: levels from the root to a 4kB page, 0 if flat
+	int num_nodes;
+	unsigned long long* nodes; // radix tables: [num_nodes * RADIX_ENTRIES], node 0 the root
+	int table_base;  // radix tables: physical address of node 0, node i is i pages above
+	long huge_pages; // radix tables: 2MB mappings
+} page_table;
+
+// One radix walk: where it went and what it read
+typedef struct page_walk {
+	int nrefs;                      // entries read
+	int refs[RADIX_MAX_LEVELS];     // physical address of each entry read
+	int path[RADIX_MAX_LEVELS];     // node visited at each depth, the root at 0
+	int depth;                      // depth the walk ended at
+	int huge;                       // ended at a 2MB page
+} page_walk;
+
+// Signatures =================================================================
+page_table* load_page_table(const char* fileName);
+void destroy_page_table(page_table* pt);
+int translate_address(const page_table* pt, unsigned long long va);
+int walk_page_table(const page_table* pt, unsigned long long va, int depth, int node, page_walk* w);
+int radix_shift(const page_table* pt, int depth);
+// ============================================================================
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * pagewalk.c - Page walker with a page-walk cache for radix page tables
+ * Walks the table on TLB misses, skipping the upper levels when a cached
+ * entry already knows the node further down
+ *
+ * The page-walk cache is fully associative with LRU replacement and holds
+ * upper-level entries of every depth together, each tagged with the
+ * virtual address bits that lead to it, like the paging-structure caches
+ * of x86-64. A walk starts at the deepest node the cache knows, so a hit
+ * on the last table level leaves one entry to read instead of four. The
+ * nodes a walk passes through are cached for the walks after it.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "pagewalk.h"
+
+// Definitions ================================================================
+/**
+ * Creates a walker whose page-walk cache has "entries" entries (0 for no
+ * cache). Returns NULL if "entries" is out of range.
+ */
+page_walker* create_walker(int entries) {
+	if (entries < 0 || entries > PWC_MAX_ENTRIES) {
+		return NULL;
+	}
+	page_walker* w = (page_walker*) calloc(1, sizeof(page_walker));
+	w->entries = entries;
+	w->pwc = (pwc_entry*) calloc(entries ? entries : 1, sizeof(pwc_entry));
+	return w;
+}
+
+void destroy_walker(page_walker* w) {
+	if (w == NULL) {
+		return;
+	}
+	free(w->pwc);
+	free(w);
+}
+
+// Virtual address bits that pick the node at "depth"
+static unsigned long long pwc_tag(const page_table* pt, unsigned long long va, int depth) {
+	return va >> radix_shift(pt, depth - 1);
+}
+
+// Caches "node" as the one at "depth" for "va", replacing the LRU entry
+static void pwc_insert(page_walker* w, const page_table* pt, unsigned long long va, int depth, int node) {
+	unsigned long long tag = pwc_tag(pt, va, depth);
+	int victim = 0;
+	for (int i = 0; i < w->entries; i++) {
+		pwc_entry* e = &w->pwc[i];
+		if (e->depth == depth && e->tag == tag) {
+			e->last_use = w->tick;
+			return;
+		}
+		if (e->depth == 0 || (w->pwc[victim].depth != 0 && e->last_use < w->pwc[victim].last_use)) {
+			victim = i;
+		}
+	}
+	w->pwc[victim].tag = tag;
+	w->pwc[victim].depth = depth;
+	w->pwc[victim].node = node;
+	w->pwc[victim].last_use = w->tick;
+}
+
+/**
+ * Translates "va" by walking radix table "pt", from the deepest node the
+ * page-walk cache has for it, and keeps the walk in w->last.
+ * Returns the physical address or PAGEFAULT_ADDR.
+ */
+int walk_translate(page_walker* w, const page_table* pt, unsigned long long va) {
+	w->tick++;
+	int depth = 0;
+	int node = 0;
+	pwc_entry* used = NULL;
+	for (int i = 0; i < w->entries; i++) {
+		pwc_entry* e = &w->pwc[i];
+		if (e->depth > depth && e->tag == pwc_tag(pt, va, e->depth)) {
+			depth = e->depth;
+			node = e->node;
+			used = e;
+		}
+	}
+	if (used != NULL) {
+		used->last_use = w->tick;
+	}
+
+	int pa = walk_page_table(pt, va, depth, node, &w->last);
+	w->walks++;
+	w->starts[depth]++;
+	w->refs += w->last.nrefs;
+	if (pa == PAGEFAULT_ADDR) {
+		w->faults++;
+	}
+	w->huge += w->last.huge;
+	for (int d = depth + 1; d <= w->last.depth && w->entries > 0; d++) {
+		pwc_insert(w, pt, va, d, w->last.path[d]);
+	}
+	return pa;
+}
+
+void print_walker_stats(const page_walker* w) {
+	printf("Page walks: %ld entries read: %ld (%.2f per walk) faults: %ld 2MB pages: %ld\n", w->walks,
+		w->refs, w->walks ? (double) w->refs / w->walks : 0.0, w->faults, w->huge);
+	printf("Page-walk cache: %d entries, walks starting at depth", w->entries);
+	for (int d = 0; d < RADIX_MAX_LEVELS; d++) {
+		printf(" %d: %ld", d, w->starts[d]);
+	}
+	printf("\n");
+	if (w->injected > 0) {
+		printf("Walk entries read through the data cache: %ld hits: %ld hit rate: %.2f%%\n", w->injected,
+			w->injected_hits, 100.0 * w->injected_hits / w->injected);
+	}
+}
+// ============================================================================
@@ -0,0 +1,44 @@
+/**
+ * pagewalk.h - Page walker with a page-walk cache for radix page tables
+ * Walks the table on TLB misses, skipping the upper levels when a cached
+ * entry already knows the node further down
+ **/
+
+#ifndef PAGEWALK_H
+#define PAGEWALK_H
+
+#include "pagetable.h"
+
+#define PWC_MAX_ENTRIES 1024
+
+// The node a walk reaches at "depth" for virtual addresses whose bits
+// above that depth's index equal "tag"
+typedef struct pwc_entry {
+	unsigned long long tag;
+	int depth;               // 1 to levels - 1, 0 when the entry is invalid
+	int node;
+	unsigned long last_use;
+} pwc_entry;
+
+typedef struct page_walker {
+	int entries;             // page-walk cache entries, 0 for none
+	pwc_entry* pwc;
+	unsigned long tick;
+	page_walk last;          // the latest walk; its user clears last.nrefs
+	long walks;
+	long refs;               // entries read, over all walks
+	long starts[RADIX_MAX_LEVELS]; // walks starting at each depth
+	long faults;
+	long huge;               // walks ending at a 2MB page
+	long injected;           // entries read through the data cache
+	long injected_hits;
+} page_walker;
+
+// Signatures =================================================================
+page_walker* create_walker(int entries);
+void destroy_walker(page_walker* w);
+int walk_translate(page_walker* w, const page_table* pt, unsigned long long va);
+void print_walker_stats(const page_walker* w);
+// ============================================================================
+
+#endif
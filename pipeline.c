@@ -0,0 +1,204 @@
+/**
+ * pipeline.c - Pipelined single-cache run for cachesimplus
+ * Parses, translates, simulates and formats the trace on four threads that
+ * hand batches of records down a chain of lock-free rings
+ *
+ * A fixed pool of batches circulates parse -> translate -> simulate ->
+ * format -> parse. Each ring has exactly one producer and one consumer, so
+ * it needs no locks: the producer publishes a slot by advancing "tail"
+ * with release ordering and the consumer frees it by advancing "head".
+ * Every stage owns the state it touches (the trace reader, the TLB, the
+ * cache and statistics, the output writer), and batches stay in trace
+ * order, so the output is the same as a sequential run's. Wall time comes
+ * down to that of the slowest stage, given a core per stage.
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "pipeline.h"
+
+typedef struct pipeline {
+	trace_reader* trace;
+	const char* trace_name;
+	const page_table* pt;
+	tlb* t;
+	cache* c;
+	run_stats* stats;
+	output_writer* out;
+	spsc_ring rings[PIPE_STAGES]; // [i] feeds stage i
+	int stop;                     // set if the threads couldn't all start
+	long malformed;
+} pipeline;
+
+// Definitions ================================================================
+// Waits for room, which only runs out if more batches are queued than exist
+static void ring_push(spsc_ring* r, pipe_batch* b) {
+	unsigned long tail = r->tail;
+	while (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == PIPE_RING_SIZE) {
+		sched_yield();
+	}
+	r->slots[tail & (PIPE_RING_SIZE - 1)] = b;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Waits for the next batch. Returns NULL at the end of the trace or if
+// the pipeline was stopped.
+static pipe_batch* ring_pop(pipeline* p, spsc_ring* r) {
+	unsigned long head = r->head;
+	while (__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == head) {
+		if (__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+			return NULL;
+		}
+		sched_yield();
+	}
+	pipe_batch* b = r->slots[head & (PIPE_RING_SIZE - 1)];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return b;
+}
+
+// Copies records into batches, leaving room in the arena for every load
+static void* parse_stage(void* arg) {
+	pipeline* p = (pipeline*) arg;
+	const trace_record* rec;
+	int status = 1;
+	while (status != 0) {
+		pipe_batch* b = ring_pop(p, &p->rings[PIPE_PARSE]);
+		if (b == NULL) {
+			return NULL;
+		}
+		b->count = 0;
+		b->arena_len = 0;
+		while (b->count < PIPE_BATCH && (status = next_record(p->trace, &rec)) != 0) {
+			if (status < 0) {
+				fprintf(stderr, "%s:%ld: malformed trace record, skipped\n", p->trace_name, p->trace->line);
+				p->malformed++;
+				continue;
+			}
+			pipe_item* it = &b->items[b->count++];
+			it->rec = *rec;
+			if (rec->op == TRACE_LOAD) {
+				it->data = b->arena_len;
+				b->arena_len += rec->size;
+				if (b->arena_len + PIPE_MAX_ACCESS > (int) sizeof(b->arena)) {
+					break;
+				}
+			}
+		}
+		ring_push(&p->rings[PIPE_TRANSLATE], b);
+	}
+	ring_push(&p->rings[PIPE_TRANSLATE], NULL);
+	return NULL;
+}
+
+static void* translate_stage(void* arg) {
+	pipeline* p = (pipeline*) arg;
+	pipe_batch* b;
+	while ((b = ring_pop(p, &p->rings[PIPE_TRANSLATE])) != NULL) {
+		for (int i = 0; i < b->count; i++) {
+			pipe_item* it = &b->items[i];
+			it->pa = (p->t != NULL) ? tlb_translate(p->t, p->pt, trace_vaddr(&it->rec))
+				: translate_address(p->pt, trace_vaddr(&it->rec));
+		}
+		ring_push(&p->rings[PIPE_SIMULATE], b);
+	}
+	if (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+		ring_push(&p->rings[PIPE_SIMULATE], NULL);
+	}
+	return NULL;
+}
+
+static void* simulate_stage(void* arg) {
+	pipeline* p = (pipeline*) arg;
+	pipe_batch* b;
+	while ((b = ring_pop(p, &p->rings[PIPE_SIMULATE])) != NULL) {
+		for (int i = 0; i < b->count; i++) {
+			pipe_item* it = &b->items[i];
+			if (it->pa == PAGEFAULT_ADDR) {
+				if (p->stats != NULL) p->stats->page_faults++;
+				continue;
+			}
+			int is_store = (it->rec.op == TRACE_STORE);
+			it->hit = is_store ? cache_store(p->c, it->pa, it->rec.size, it->rec.data)
+				: cache_load(p->c, it->pa, it->rec.size, b->arena + it->data);
+			if (p->stats != NULL) stats_access(p->stats, it->pa, it->rec.size, is_store, it->hit);
+		}
+		ring_push(&p->rings[PIPE_FORMAT], b);
+	}
+	if (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+		ring_push(&p->rings[PIPE_FORMAT], NULL);
+	}
+	return NULL;
+}
+
+// Runs on the calling thread; sends each batch back to parsing when done
+static void format_stage(pipeline* p) {
+	pipe_batch* b;
+	while ((b = ring_pop(p, &p->rings[PIPE_FORMAT])) != NULL) {
+		for (int i = 0; i < b->count && p->out != NULL; i++) {
+			const pipe_item* it = &b->items[i];
+			if (it->pa == PAGEFAULT_ADDR) {
+				write_pagefault(p->out);
+			}
+			else if (it->rec.op == TRACE_LOAD) {
+				write_load(p->out, trace_vaddr(&it->rec), it->hit, b->arena + it->data, it->rec.size);
+			}
+			else {
+				write_store(p->out, trace_vaddr(&it->rec), it->hit);
+			}
+		}
+		ring_push(&p->rings[PIPE_PARSE], b);
+	}
+}
+
+/**
+ * Runs the whole trace through cache "c" as the sequential loop in
+ * cachesimplus would, with per-access lines going to "out" (if not NULL)
+ * and totals to "stats" (if not NULL).
+ * Returns 0, or -1 without reading anything if the threads can't start.
+ */
+int run_pipeline(trace_reader* trace, const char* traceName, const page_table* pt, tlb* t, cache* c,
+		run_stats* stats, output_writer* out) {
+	pipeline* p = (pipeline*) calloc(1, sizeof(pipeline));
+	p->trace = trace;
+	p->trace_name = traceName;
+	p->pt = pt;
+	p->t = t;
+	p->c = c;
+	p->stats = stats;
+	p->out = out;
+	pipe_batch* batches = (pipe_batch*) malloc(PIPE_BATCHES * sizeof(pipe_batch));
+	for (int i = 0; i < PIPE_BATCHES; i++) {
+		ring_push(&p->rings[PIPE_PARSE], &batches[i]);
+	}
+
+	// downstream first, so that if a thread fails to start nothing has
+	// been read yet and the caller can fall back to a sequential run
+	void* (*stages[])(void*) = { simulate_stage, translate_stage, parse_stage };
+	pthread_t threads[3];
+	int started = 0;
+	while (started < 3 && pthread_create(&threads[started], NULL, stages[started], p) == 0) {
+		started++;
+	}
+	if (started < 3) {
+		__atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+	}
+	else {
+		format_stage(p);
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	if (stats != NULL) {
+		stats->malformed += p->malformed;
+	}
+	int result = (started < 3) ? -1 : 0;
+	free(batches);
+	free(p);
+	return result;
+}
+// ============================================================================
@@ -0,0 +1,58 @@
+/**
+ * pipeline.h - Pipelined single-cache run for cachesimplus
+ * Parses, translates, simulates and formats the trace on four threads that
+ * hand batches of records down a chain of lock-free rings
+ **/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "cache.h"
+#include "output.h"
+#include "pagetable.h"
+#include "stats.h"
+#include "tlb.h"
+#include "trace.h"
+
+#define PIPE_BATCH 4096        // records per batch
+#define PIPE_BATCHES 8         // batches in flight
+#define PIPE_RING_SIZE 16      // slots per ring, a power of two above PIPE_BATCHES
+#define PIPE_MAX_ACCESS 255    // largest access a trace record can hold
+
+// Stages, and the ring each one reads from
+#define PIPE_PARSE 0           // reads empty batches back from formatting
+#define PIPE_TRANSLATE 1
+#define PIPE_SIMULATE 2
+#define PIPE_FORMAT 3
+#define PIPE_STAGES 4
+
+typedef struct pipe_item {
+	trace_record rec;      // copied out of the reader
+	int pa;                // physical address, PAGEFAULT_ADDR if unmapped
+	int hit;
+	int data;              // loads, offset of the loaded bytes in the batch's arena
+} pipe_item;
+
+typedef struct pipe_batch {
+	int count;
+	int arena_len;
+	pipe_item items[PIPE_BATCH];
+	unsigned char arena[PIPE_BATCH * TRACE_MAX_DATA]; // loaded bytes
+} pipe_batch;
+
+// Single-producer, single-consumer ring of batch pointers. A NULL batch
+// marks the end of the trace.
+typedef struct spsc_ring {
+	pipe_batch* slots[PIPE_RING_SIZE];
+	unsigned long head;    // next slot to read, only the consumer writes it
+	char pad[64];          // keeps head and tail on separate cache lines
+	unsigned long tail;    // next slot to write, only the producer writes it
+	char pad2[64];
+} spsc_ring;
+
+// Signatures =================================================================
+int run_pipeline(trace_reader* trace, const char* traceName, const page_table* pt, tlb* t, cache* c,
+	run_stats* stats, output_writer* out);
+// ============================================================================
+
+#endif
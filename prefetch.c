@@ -0,0 +1,205 @@
+/**
+ * prefetch.c - Hardware prefetcher models for cachesimplus
+ * Next-N-line and stride prefetchers that suggest blocks to fill into the
+ * cache, and stream buffers that hold prefetched blocks on the side
+ *
+ * Traces carry no PCs, so the stride table is indexed by the 4kB region of
+ * the access instead: a stride seen twice in a row within a region is
+ * trusted and followed "degree" steps ahead. Stream buffers are allocated
+ * on a miss no buffer covers, start at the next block and stay "degree"
+ * blocks ahead of the accesses they serve.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+#include "memory.h"
+
+// Definitions ================================================================
+int parse_prefetcher(const char* name) {
+	if (strcmp(name, "none") == 0) return PF_NONE;
+	if (strcmp(name, "nextline") == 0) return PF_NEXTLINE;
+	if (strcmp(name, "stride") == 0) return PF_STRIDE;
+	if (strcmp(name, "stream") == 0) return PF_STREAM;
+	return -1;
+}
+
+const char* prefetcher_name(int kind) {
+	static const char* names[] = {"none", "nextline", "stride", "stream"};
+	return names[kind];
+}
+
+/**
+ * Creates a prefetcher of "kind" looking "degree" blocks ahead, or
+ * returns NULL for PF_NONE or a bad degree.
+ */
+prefetcher* create_prefetcher(int kind, int degree, int block_size) {
+	if (kind == PF_NONE || degree < 1 || degree > PF_MAX_DEGREE) {
+		return NULL;
+	}
+	prefetcher* p = (prefetcher*) calloc(1, sizeof(prefetcher));
+	p->kind = kind;
+	p->degree = degree;
+	p->block_size = block_size;
+	int n = block_size;
+	while (n >>= 1) p->bbits++;
+	for (int i = 0; i < PF_STRIDE_ENTRIES; i++) {
+		p->table[i].region = -1;
+	}
+	if (kind == PF_STREAM) {
+		for (int i = 0; i < PF_STREAMS; i++) {
+			p->streams[i].block = (int*) malloc(degree * sizeof(int));
+			p->streams[i].data = (unsigned char*) malloc((size_t) degree * block_size);
+		}
+	}
+	return p;
+}
+
+void destroy_prefetcher(prefetcher* p) {
+	if (p == NULL) {
+		return;
+	}
+	for (int i = 0; i < PF_STREAMS; i++) {
+		free(p->streams[i].block);
+		free(p->streams[i].data);
+	}
+	free(p);
+}
+
+/**
+ * Trains on a demand access at "address" and puts the addresses of the
+ * blocks to fill into the cache in "blocks" (room for PF_MAX_DEGREE).
+ * Next-line only fires on a miss. Returns how many were suggested.
+ */
+int prefetch_suggest(prefetcher* p, int address, int miss, int* blocks) {
+	int block = address >> p->bbits;
+	int n = 0;
+	if (p->kind == PF_NEXTLINE) {
+		if (miss) {
+			for (int k = 1; k <= p->degree; k++) {
+				blocks[n++] = (block + k) << p->bbits;
+			}
+		}
+	}
+	else if (p->kind == PF_STRIDE) {
+		int region = (unsigned int) address >> PF_REGION_BITS;
+		stride_entry* e = &p->table[region & (PF_STRIDE_ENTRIES - 1)];
+		if (e->region != region) {
+			e->region = region;
+			e->last_block = block;
+			e->stride = 0;
+			e->confidence = 0;
+			return 0;
+		}
+		int stride = block - e->last_block;
+		if (stride == 0) {
+			return 0;
+		}
+		if (stride == e->stride) {
+			if (e->confidence < 2) e->confidence++;
+		}
+		else {
+			e->stride = stride;
+			e->confidence = 0;
+		}
+		e->last_block = block;
+		if (e->confidence >= 1) {
+			for (int k = 1; k <= p->degree; k++) {
+				blocks[n++] = (block + k * stride) << p->bbits;
+			}
+		}
+	}
+	return n;
+}
+
+// Fetches the buffer's next block into its tail
+static void stream_fetch(prefetcher* p, stream_buffer* s, const write_buffer* wb) {
+	int slot = (s->head + s->count) % p->degree;
+	int address = s->next_block << p->bbits;
+	unsigned char* dest = s->data + (size_t) slot * p->block_size;
+	read_from_memory(dest, address, p->block_size);
+	if (wb != NULL) {
+		write_buffer_forward(wb, address, dest, p->block_size);
+	}
+	s->block[slot] = s->next_block;
+	s->next_block++;
+	s->count++;
+	p->issued++;
+}
+
+/**
+ * Looks for the block holding "address" in the stream buffers on a cache
+ * miss. If a buffer has it, the block is copied into "line", the blocks
+ * ahead of it are dropped and the buffer tops itself up; returns 1.
+ * Otherwise the least recently used buffer restarts after this block and
+ * 0 is returned, leaving the demand fetch to the caller.
+ */
+int stream_take(prefetcher* p, int address, unsigned char* line, const write_buffer* wb) {
+	int block = address >> p->bbits;
+	p->tick++;
+	for (int i = 0; i < PF_STREAMS; i++) {
+		stream_buffer* s = &p->streams[i];
+		if (!s->valid) continue;
+		for (int k = 0; k < s->count; k++) {
+			int slot = (s->head + k) % p->degree;
+			if (s->block[slot] != block) continue;
+
+			memcpy(line, s->data + (size_t) slot * p->block_size, p->block_size);
+			p->useful++;
+			p->unused += k;
+			s->head = (slot + 1) % p->degree;
+			s->count -= k + 1;
+			s->last_use = p->tick;
+			while (s->count < p->degree) {
+				stream_fetch(p, s, wb);
+			}
+			return 1;
+		}
+	}
+
+	stream_buffer* victim = &p->streams[0];
+	for (int i = 1; i < PF_STREAMS; i++) {
+		if (!p->streams[i].valid || (victim->valid && p->streams[i].last_use < victim->last_use)) {
+			victim = &p->streams[i];
+		}
+	}
+	if (victim->valid) {
+		p->unused += victim->count;
+	}
+	victim->valid = 1;
+	victim->head = 0;
+	victim->count = 0;
+	victim->next_block = block + 1;
+	victim->last_use = p->tick;
+	while (victim->count < p->degree) {
+		stream_fetch(p, victim, wb);
+	}
+	return 0;
+}
+
+/**
+ * Drops any stream buffer blocks overlapping a memory write, so they
+ * can't hand out stale data later.
+ */
+void stream_invalidate(prefetcher* p, int address, int size) {
+	if (p->kind != PF_STREAM) {
+		return;
+	}
+	int first = address >> p->bbits;
+	int last = (address + size - 1) >> p->bbits;
+	for (int i = 0; i < PF_STREAMS; i++) {
+		stream_buffer* s = &p->streams[i];
+		if (!s->valid) continue;
+		for (int k = 0; k < s->count; k++) {
+			int b = s->block[(s->head + k) % p->degree];
+			if (b >= first && b <= last) {
+				// everything from here on goes; the buffer refetches it
+				p->unused += s->count - k;
+				s->next_block = b;
+				s->count = k;
+				break;
+			}
+		}
+	}
+}
+// ============================================================================
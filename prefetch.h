@@ -0,0 +1,63 @@
+/**
+ * prefetch.h - Hardware prefetcher models for cachesimplus
+ * Next-N-line and stride prefetchers that suggest blocks to fill into the
+ * cache, and stream buffers that hold prefetched blocks on the side
+ **/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "writebuf.h"
+
+#define PF_NONE 0
+#define PF_NEXTLINE 1
+#define PF_STRIDE 2
+#define PF_STREAM 3
+
+#define PF_MAX_DEGREE 16
+#define PF_STRIDE_ENTRIES 64    // stride table, direct-mapped by 4kB region
+#define PF_REGION_BITS 12
+#define PF_STREAMS 4            // stream buffers
+
+typedef struct stride_entry {
+	int region;
+	int last_block;
+	int stride;
+	int confidence;
+} stride_entry;
+
+typedef struct stream_buffer {
+	int valid;
+	int next_block;       // block the buffer will fetch next
+	int count;            // blocks held, oldest at "head"
+	int head;
+	int* block;           // [degree]
+	unsigned char* data;  // [degree * block_size]
+	unsigned long last_use;
+} stream_buffer;
+
+typedef struct prefetcher {
+	int kind;             // PF_*
+	int degree;           // lines ahead, stride steps or stream buffer depth
+	int block_size;
+	int bbits;
+	stride_entry table[PF_STRIDE_ENTRIES];
+	stream_buffer streams[PF_STREAMS];
+	unsigned long tick;
+	long issued;          // blocks fetched from memory by the prefetcher
+	long useful;          // of those, used by a demand access
+	long unused;          // evicted or dropped before any use
+	long redundant;       // suggested but already cached
+} prefetcher;
+
+// Signatures =================================================================
+int parse_prefetcher(const char* name);
+const char* prefetcher_name(int kind);
+prefetcher* create_prefetcher(int kind, int degree, int block_size);
+void destroy_prefetcher(prefetcher* p);
+int prefetch_suggest(prefetcher* p, int address, int miss, int* blocks);
+int stream_take(prefetcher* p, int address, unsigned char* line, const write_buffer* wb);
+void stream_invalidate(prefetcher* p, int address, int size);
+// ============================================================================
+
+#endif
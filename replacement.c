@@ -0,0 +1,317 @@
+/**
+ * replacement.c - Replacement policies for the cache engine
+ * LRU, tree pseudo-LRU, FIFO, random, SRRIP, BRRIP and Belady's OPT
+ *
+ * The cache calls repl_hit() on a hit, repl_fill() after placing a new
+ * block, repl_skip() on a miss it doesn't fill (a store that doesn't
+ * allocate) and repl_victim() when a full set needs a way freed. Empty
+ * ways are filled by the cache before any policy is consulted.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "replacement.h"
+
+static const char* policy_names[] = { "lru", "plru", "fifo", "random", "srrip", "brrip", "opt" };
+
+// Definitions ================================================================
+/**
+ * Maps a policy name from the command line to its REPL_* id, or -1.
+ */
+int parse_repl_policy(const char* name) {
+	for (int i = 0; i < (int) (sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+		if (strcmp(name, policy_names[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const char* repl_policy_name(int policy) {
+	return policy_names[policy];
+}
+
+/**
+ * Creates the per-set bookkeeping for "policy". Returns NULL if the policy
+ * can't be used with this geometry (tree PLRU needs a power-of-two assoc).
+ */
+repl_state* create_repl(int policy, int nsets, int assoc, unsigned int seed) {
+	if (policy == REPL_PLRU && (assoc & (assoc - 1)) != 0) {
+		return NULL;
+	}
+
+	repl_state* r = (repl_state*) calloc(1, sizeof(repl_state));
+	r->policy = policy;
+	r->nsets = nsets;
+	r->assoc = assoc;
+	r->seed = seed ? seed : 2463534242u;
+	int lines = nsets * assoc;
+
+	switch (policy) {
+	case REPL_LRU:
+		r->lru_prev = (int*) malloc(lines * sizeof(int));
+		r->lru_next = (int*) malloc(lines * sizeof(int));
+		r->lru_head = (int*) malloc(nsets * sizeof(int));
+		r->lru_tail = (int*) malloc(nsets * sizeof(int));
+		// Start each set ordered A-1 (MRU) ... 0 (LRU)
+		for (int set = 0; set < nsets; set++) {
+			int base = set * assoc;
+			for (int w = 0; w < assoc; w++) {
+				r->lru_prev[base + w] = (w + 1 < assoc) ? w + 1 : -1;
+				r->lru_next[base + w] = w - 1;
+			}
+			r->lru_head[set] = assoc - 1;
+			r->lru_tail[set] = 0;
+		}
+		break;
+	case REPL_PLRU:
+		r->bits = (unsigned char*) calloc(nsets * (assoc > 1 ? assoc - 1 : 1), sizeof(unsigned char));
+		break;
+	case REPL_FIFO:
+		r->fifo_next = (int*) calloc(nsets, sizeof(int));
+		break;
+	case REPL_SRRIP:
+	case REPL_BRRIP:
+		r->bits = (unsigned char*) malloc(lines * sizeof(unsigned char));
+		memset(r->bits, RRPV_MAX, lines);
+		break;
+	case REPL_OPT:
+		r->line_next = (long*) malloc(lines * sizeof(long));
+		for (int i = 0; i < lines; i++) {
+			r->line_next[i] = LONG_MAX;
+		}
+		break;
+	}
+	return r;
+}
+
+void destroy_repl(repl_state* r) {
+	if (r == NULL) {
+		return;
+	}
+	free(r->lru_prev);
+	free(r->lru_next);
+	free(r->lru_head);
+	free(r->lru_tail);
+	free(r->bits);
+	free(r->fifo_next);
+	free(r->line_next);
+	free(r);
+}
+
+// xorshift32, so runs with the same seed replay exactly
+static unsigned int next_random(repl_state* r) {
+	unsigned int x = r->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	r->seed = x;
+	return x;
+}
+
+// Moves "way" to the MRU end of the set's recency list in O(1)
+static void lru_touch(repl_state* r, int set, int way) {
+	if (r->assoc == 1 || r->lru_head[set] == way) {
+		return;
+	}
+	int base = set * r->assoc;
+	int* prev = r->lru_prev + base;
+	int* next = r->lru_next + base;
+
+	// unlink; way isn't the head so prev[way] is valid
+	next[prev[way]] = next[way];
+	if (next[way] >= 0) {
+		prev[next[way]] = prev[way];
+	}
+	else {
+		r->lru_tail[set] = prev[way];
+	}
+
+	// push at the head
+	prev[way] = -1;
+	next[way] = r->lru_head[set];
+	prev[r->lru_head[set]] = way;
+	r->lru_head[set] = way;
+}
+
+// Points every tree node on the path to "way" away from it
+static void plru_touch(repl_state* r, int set, int way) {
+	unsigned char* tree = r->bits + set * (r->assoc - 1);
+	int node = 0, lo = 0, span = r->assoc;
+	while (span > 1) {
+		span >>= 1;
+		if (way < lo + span) {
+			tree[node] = 1;
+			node = 2 * node + 1;
+		}
+		else {
+			tree[node] = 0;
+			node = 2 * node + 2;
+			lo += span;
+		}
+	}
+}
+
+static int plru_victim(repl_state* r, int set) {
+	unsigned char* tree = r->bits + set * (r->assoc - 1);
+	int node = 0, lo = 0, span = r->assoc;
+	while (span > 1) {
+		span >>= 1;
+		if (tree[node] == 0) {
+			node = 2 * node + 1;
+		}
+		else {
+			node = 2 * node + 2;
+			lo += span;
+		}
+	}
+	return lo;
+}
+
+static int rrip_victim(repl_state* r, int set) {
+	unsigned char* rrpv = r->bits + set * r->assoc;
+	for (;;) {
+		for (int w = 0; w < r->assoc; w++) {
+			if (rrpv[w] >= RRPV_MAX) {
+				return w;
+			}
+		}
+		for (int w = 0; w < r->assoc; w++) {
+			rrpv[w]++;
+		}
+	}
+}
+
+static long opt_next(repl_state* r) {
+	long next = (r->position < r->num_accesses) ? r->next_use[r->position] : LONG_MAX;
+	r->position++;
+	return next;
+}
+
+static int opt_victim(repl_state* r, int set) {
+	const long* line_next = r->line_next + set * r->assoc;
+	int victim = 0;
+	for (int w = 1; w < r->assoc; w++) {
+		if (line_next[w] > line_next[victim]) {
+			victim = w;
+		}
+	}
+	return victim;
+}
+
+void repl_hit(repl_state* r, int set, int way) {
+	switch (r->policy) {
+	case REPL_LRU:
+		lru_touch(r, set, way);
+		break;
+	case REPL_PLRU:
+		if (r->assoc > 1) plru_touch(r, set, way);
+		break;
+	case REPL_SRRIP:
+	case REPL_BRRIP:
+		r->bits[set * r->assoc + way] = 0;
+		break;
+	case REPL_OPT:
+		r->line_next[set * r->assoc + way] = opt_next(r);
+		break;
+	}
+}
+
+void repl_fill(repl_state* r, int set, int way) {
+	switch (r->policy) {
+	case REPL_LRU:
+		lru_touch(r, set, way);
+		break;
+	case REPL_PLRU:
+		if (r->assoc > 1) plru_touch(r, set, way);
+		break;
+	case REPL_FIFO:
+		if (r->fifo_next[set] == way) {
+			r->fifo_next[set] = (way + 1) % r->assoc;
+		}
+		break;
+	case REPL_SRRIP:
+		r->bits[set * r->assoc + way] = RRPV_MAX - 1;
+		break;
+	case REPL_BRRIP:
+		r->bits[set * r->assoc + way] = (next_random(r) % BRRIP_LONG == 0) ? RRPV_MAX - 1 : RRPV_MAX;
+		break;
+	case REPL_OPT:
+		r->line_next[set * r->assoc + way] = opt_next(r);
+		break;
+	}
+}
+
+// A miss that places nothing still uses up its access in OPT's future,
+// which lists every block access
+void repl_skip(repl_state* r) {
+	if (r->policy == REPL_OPT) {
+		opt_next(r);
+	}
+}
+
+/**
+ * Picks the way to evict from a full set.
+ */
+int repl_victim(repl_state* r, int set) {
+	switch (r->policy) {
+	case REPL_LRU:
+		return r->lru_tail[set];
+	case REPL_PLRU:
+		return (r->assoc > 1) ? plru_victim(r, set) : 0;
+	case REPL_FIFO:
+		return r->fifo_next[set];
+	case REPL_RANDOM:
+		return next_random(r) % r->assoc;
+	case REPL_SRRIP:
+	case REPL_BRRIP:
+		return rrip_victim(r, set);
+	case REPL_OPT:
+		return opt_victim(r, set);
+	}
+	return 0;
+}
+
+/**
+ * For each access i in "blocks" (block addresses in trace order), finds the
+ * index of the next access to the same block, or LONG_MAX if there is none.
+ * The caller frees the result.
+ */
+long* compute_next_use(const long* blocks, long n) {
+	long* next = (long*) malloc((n > 0 ? n : 1) * sizeof(long));
+
+	// Open-addressing map from block -> most recent (later) index
+	long cap = 16;
+	while (cap < 2 * n) cap <<= 1;
+	long* keys = (long*) malloc(cap * sizeof(long));
+	long* vals = (long*) malloc(cap * sizeof(long));
+	for (long i = 0; i < cap; i++) {
+		keys[i] = -1;
+	}
+
+	for (long i = n - 1; i >= 0; i--) {
+		unsigned long h = ((unsigned long) blocks[i] * 0x9E3779B97F4A7C15ul) & (cap - 1);
+		while (keys[h] != -1 && keys[h] != blocks[i]) {
+			h = (h + 1) & (cap - 1);
+		}
+		next[i] = (keys[h] == -1) ? LONG_MAX : vals[h];
+		keys[h] = blocks[i];
+		vals[h] = i;
+	}
+
+	free(keys);
+	free(vals);
+	return next;
+}
+
+/**
+ * Hands OPT the next-use table for the upcoming access stream. The table
+ * must stay alive for as long as "r" is used.
+ */
+void repl_set_future(repl_state* r, const long* next_use, long n) {
+	r->next_use = next_use;
+	r->num_accesses = n;
+	r->position = 0;
+}
+// ============================================================================
@@ -0,0 +1,50 @@
+/**
+ * replacement.h - Replacement policies for the cache engine
+ * LRU, tree pseudo-LRU, FIFO, random, SRRIP, BRRIP and Belady's OPT
+ **/
+
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#define REPL_LRU 0
+#define REPL_PLRU 1
+#define REPL_FIFO 2
+#define REPL_RANDOM 3
+#define REPL_SRRIP 4
+#define REPL_BRRIP 5
+#define REPL_OPT 6
+
+#define RRPV_MAX 3      // 2-bit re-reference prediction values
+#define BRRIP_LONG 32   // BRRIP inserts at RRPV_MAX - 1 once every this many fills
+
+typedef struct repl_state {
+	int policy;
+	int nsets;
+	int assoc;
+	unsigned int seed;
+	int* lru_prev;          // LRU: [nsets * assoc], next more recent way, -1 at MRU
+	int* lru_next;          // LRU: [nsets * assoc], next less recent way, -1 at LRU
+	int* lru_head;          // LRU: [nsets]
+	int* lru_tail;          // LRU: [nsets]
+	unsigned char* bits;    // PLRU: [nsets * (assoc - 1)] tree; SRRIP/BRRIP: [nsets * assoc] RRPVs
+	int* fifo_next;         // FIFO: [nsets] next way to replace
+	const long* next_use;   // OPT: per access, index of the next access to the same block
+	long num_accesses;      // OPT: length of next_use
+	long position;          // OPT: index of the current access
+	long* line_next;        // OPT: [nsets * assoc] next use of each resident block
+} repl_state;
+
+// Signatures =================================================================
+int parse_repl_policy(const char* name);
+const char* repl_policy_name(int policy);
+repl_state* create_repl(int policy, int nsets, int assoc, unsigned int seed);
+void destroy_repl(repl_state* r);
+void repl_hit(repl_state* r, int set, int way);
+void repl_fill(repl_state* r, int set, int way);
+void repl_skip(repl_state* r);
+int repl_victim(repl_state* r, int set);
+long* compute_next_use(const long* blocks, long n);
+void repl_set_future(repl_state* r, const long* next_use, long n);
+// ============================================================================
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * sample.c - Hash-based sampling for approximate simulation
+ * Picks a pseudo-random but repeatable subset of sets or blocks by hashing
+ * them, and estimates the error of a miss ratio measured on that subset
+ **/
+
+#include <math.h>
+#include "sample.h"
+
+// Definitions ================================================================
+/**
+ * Selection threshold for sampling a "rate" fraction (0 < rate <= 1) of
+ * hashed keys with sample_selected().
+ */
+unsigned long long sample_threshold(double rate) {
+	if (rate >= 1.0) {
+		return 1ull << 32;
+	}
+	unsigned long long t = (unsigned long long) (rate * 4294967296.0);
+	return (t > 0) ? t : 1;
+}
+
+/**
+ * Standard error of the miss ratio sum(misses) / sum(accesses), treating
+ * the SAMPLE_UNITS groups as a random sample of clusters (the usual ratio
+ * estimator variance) with finite population correction for having looked
+ * at a "fraction" of the population. Returns 0 for a complete census or
+ * too few non-empty groups to tell.
+ */
+double sample_error(const long* accesses, const long* misses, double fraction) {
+	double total = 0, missed = 0;
+	int n = 0;
+	for (int u = 0; u < SAMPLE_UNITS; u++) {
+		if (accesses[u] > 0) {
+			total += accesses[u];
+			missed += misses[u];
+			n++;
+		}
+	}
+	if (fraction >= 1.0 || n < 2) {
+		return 0.0;
+	}
+
+	double ratio = missed / total;
+	double mean = total / n;
+	double spread = 0;
+	for (int u = 0; u < SAMPLE_UNITS; u++) {
+		if (accesses[u] > 0) {
+			double r = misses[u] - ratio * accesses[u];
+			spread += r * r;
+		}
+	}
+	double variance = (1.0 - fraction) * spread / (n - 1) / (n * mean * mean);
+	return sqrt(variance);
+}
+// ============================================================================
@@ -0,0 +1,36 @@
+/**
+ * sample.h - Hash-based sampling for approximate simulation
+ * Picks a pseudo-random but repeatable subset of sets or blocks by hashing
+ * them, and estimates the error of a miss ratio measured on that subset
+ **/
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+// Sampled sets/blocks are spread over this many groups by hash; the spread
+// of miss ratios between groups gives the error estimate
+#define SAMPLE_UNITS 64
+
+// Mixes "key" into 64 well distributed bits (splitmix64 finalizer)
+static inline unsigned long long sample_hash(unsigned long long key) {
+	key += 0x9E3779B97F4A7C15ull;
+	key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+	key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+	return key ^ (key >> 31);
+}
+
+// The top 32 bits of the hash decide selection, the low bits the unit
+static inline int sample_selected(unsigned long long hash, unsigned long long threshold) {
+	return (hash >> 32) < threshold;
+}
+
+static inline int sample_unit(unsigned long long hash) {
+	return (int) (hash & (SAMPLE_UNITS - 1));
+}
+
+// Signatures =================================================================
+unsigned long long sample_threshold(double rate);
+double sample_error(const long* accesses, const long* misses, double fraction);
+// ============================================================================
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * stats.c - End-of-run statistics for cachesimplus
+ * Collects per-access counts for one cache, classifies its misses with the
+ * 3C model and reports them with memory.c's traffic counters
+ *
+ * The shadow fully-associative LRU cache is the stack-distance analysis
+ * from mrc.c: a block hits in an LRU cache of N lines exactly when fewer
+ * than N other blocks were touched since its last use, so one O(log M)
+ * update per access classifies every miss.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "stats.h"
+#include "memory.h"
+
+// Definitions ================================================================
+run_stats* create_stats(const cache* c) {
+	run_stats* s = (run_stats*) calloc(1, sizeof(run_stats));
+	s->shadow = create_mrc(c->block_size, 1.0);
+	s->lines = (long) c->nsets * c->assoc;
+	return s;
+}
+
+void destroy_stats(run_stats* s) {
+	if (s == NULL) {
+		return;
+	}
+	destroy_mrc(s->shadow);
+	free(s);
+}
+
+/**
+ * Records one access of "size" bytes at physical "address" that "hit" or
+ * missed. A miss spanning blocks is classified by its worst block.
+ */
+void stats_access(run_stats* s, int address, int size, int is_store, int hit) {
+	long distance = mrc_access_range(s->shadow, (unsigned int) address, size);
+	if (is_store) {
+		s->stores++;
+		s->store_hits += hit;
+	}
+	else {
+		s->loads++;
+		s->load_hits += hit;
+	}
+	if (hit) {
+		return;
+	}
+	if (distance == MRC_COLD) {
+		s->compulsory++;
+	}
+	else if (distance >= s->lines) {
+		s->capacity++;
+	}
+	else {
+		s->conflict++;
+	}
+}
+
+static double percent(long part, long whole) {
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+/**
+ * Prints the report for a run of cache "c" (and TLB "t" if not NULL) as
+ * text or as one JSON object.
+ */
+void print_stats(const run_stats* s, const cache* c, const tlb* t, int json) {
+	memory_counters mem;
+	get_memory_counters(&mem);
+	long accesses = s->loads + s->stores;
+	long misses = accesses - s->load_hits - s->store_hits;
+
+	if (json) {
+		printf("{\"cache\": {\"size_kb\": %d, \"assoc\": %d, \"block_size\": %d, \"policy\": \"%s\", "
+			"\"write_through\": %s, \"write_allocate\": %s},\n", c->size_kb, c->assoc, c->block_size,
+			repl_policy_name(c->repl->policy), c->write_through ? "true" : "false",
+			c->no_write_allocate ? "false" : "true");
+		printf(" \"accesses\": %ld, \"loads\": %ld, \"stores\": %ld, \"hits\": %ld, \"misses\": %ld, "
+			"\"hit_rate\": %.2f,\n", accesses, s->loads, s->stores, accesses - misses, misses,
+			percent(accesses - misses, accesses));
+		printf(" \"load_hits\": %ld, \"store_hits\": %ld,\n", s->load_hits, s->store_hits);
+		printf(" \"compulsory_misses\": %ld, \"capacity_misses\": %ld, \"conflict_misses\": %ld,\n",
+			s->compulsory, s->capacity, s->conflict);
+		printf(" \"evictions\": %ld, \"writebacks\": %ld, \"page_faults\": %ld, \"malformed\": %ld,\n",
+			c->evictions, c->writebacks, s->page_faults, s->malformed);
+		printf(" \"memory\": {\"read_calls\": %ld, \"write_calls\": %ld, \"bytes_read\": %ld, "
+			"\"bytes_written\": %ld}", mem.read_calls, mem.write_calls, mem.bytes_read, mem.bytes_written);
+		if (t != NULL) {
+			printf(",\n \"tlb\": {\"entries\": %d, \"ways\": %d, \"hits\": %ld, \"misses\": %ld}",
+				t->entries, t->ways, t->hits, t->misses);
+		}
+		printf("}\n");
+		return;
+	}
+
+	print_cache_stats(c);
+	printf("Accesses: %ld loads: %ld stores: %ld page faults: %ld\n", accesses, s->loads, s->stores,
+		s->page_faults);
+	printf("Load hit rate: %.2f%% store hit rate: %.2f%%\n", percent(s->load_hits, s->loads),
+		percent(s->store_hits, s->stores));
+	printf("Misses: compulsory %ld (%.2f%%) capacity %ld (%.2f%%) conflict %ld (%.2f%%)\n",
+		s->compulsory, percent(s->compulsory, misses), s->capacity, percent(s->capacity, misses),
+		s->conflict, percent(s->conflict, misses));
+	printf("Evictions: %ld dirty writebacks: %ld\n", c->evictions, c->writebacks);
+	printf("Memory calls: %ld reads (%ld bytes) %ld writes (%ld bytes)\n", mem.read_calls,
+		mem.bytes_read, mem.write_calls, mem.bytes_written);
+	if (s->malformed > 0) {
+		printf("Malformed records skipped: %ld\n", s->malformed);
+	}
+}
+// ============================================================================
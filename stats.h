@@ -0,0 +1,35 @@
+/**
+ * stats.h - End-of-run statistics for cachesimplus
+ * Collects per-access counts for one cache, classifies its misses with the
+ * 3C model and reports them with memory.c's traffic counters
+ **/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "cache.h"
+#include "mrc.h"
+#include "tlb.h"
+
+typedef struct run_stats {
+	long loads;
+	long stores;
+	long load_hits;
+	long store_hits;
+	long page_faults;
+	long malformed;
+	long compulsory;      // first touch of the block
+	long capacity;        // would miss in a fully-associative LRU cache of the same size too
+	long conflict;        // would hit in that cache
+	mrc* shadow;          // stack distances stand in for the fully-associative cache
+	long lines;           // lines in the cache, the shadow's capacity
+} run_stats;
+
+// Signatures =================================================================
+run_stats* create_stats(const cache* c);
+void destroy_stats(run_stats* s);
+void stats_access(run_stats* s, int address, int size, int is_store, int hit);
+void print_stats(const run_stats* s, const cache* c, const tlb* t, int json);
+// ============================================================================
+
+#endif
@@ -0,0 +1,490 @@
+/**
+ * sweep.c - Multi-configuration sweep for cachesimplus
+ * Runs every cache geometry in a list side by side over a single pass of
+ * the trace and reports one row of totals per configuration
+ *
+ * Each record is read, decoded and translated once, then handed to every
+ * cache as a tag-only access, so a sweep of many geometries costs about as
+ * much as one trace parse plus the lookups themselves.
+ *
+ * With more than one thread the decoded accesses go into a read-only
+ * buffer shared by a pool of workers. Each configuration is one task; every
+ * worker starts with its own deque of tasks and steals from the others
+ * once it runs dry, so a few slow (wide, OPT) caches don't hold up the rest.
+ *
+ * A sampled sweep only simulates a hash-selected fraction of each cache's
+ * sets. Sets don't interact, so the sampled sets behave exactly as in the
+ * full run and their hit rate estimates the whole cache's; counts are
+ * scaled up by the share of accesses the sampled sets saw.
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "sweep.h"
+
+#define SWEEP_CHUNK (1 << 20) // accesses decoded per round of a threaded sweep
+
+// Definitions ================================================================
+/**
+ * Parses "spec" as a comma separated list of values, each one either a
+ * number or a "lo-hi" range of powers of two ("1-64" is 1,2,4,...,64).
+ * Returns how many values went into "values", or -1 on a bad spec.
+ */
+int parse_value_list(const char* spec, int* values, int max) {
+	int n = 0;
+	const char* p = spec;
+	while (*p != '\0') {
+		char* end;
+		long lo = strtol(p, &end, 10);
+		long hi = lo;
+		if (end == p || lo < 1) return -1;
+		p = end;
+		if (*p == '-') {
+			hi = strtol(p + 1, &end, 10);
+			if (end == p + 1 || hi < lo) return -1;
+			p = end;
+		}
+		for (long v = lo; v <= hi; v *= 2) {
+			if (n == max) return -1;
+			values[n++] = (int) v;
+		}
+		if (*p == ',') {
+			p++;
+			if (*p == '\0') return -1;
+		}
+		else if (*p != '\0') {
+			return -1;
+		}
+	}
+	return n;
+}
+
+/**
+ * Parses a comma separated list of replacement policy names.
+ * Returns how many went into "policies", or -1 on an unknown name.
+ */
+int parse_policy_list(const char* spec, int* policies, int max) {
+	int n = 0;
+	const char* p = spec;
+	while (*p != '\0') {
+		const char* comma = strchr(p, ',');
+		size_t len = (comma != NULL) ? (size_t) (comma - p) : strlen(p);
+		char name[16];
+		if (len == 0 || len >= sizeof(name) || n == max) return -1;
+		memcpy(name, p, len);
+		name[len] = '\0';
+		int policy = parse_repl_policy(name);
+		if (policy < 0) return -1;
+		policies[n++] = policy;
+		p += len;
+		if (*p == ',') p++;
+	}
+	return n;
+}
+
+/**
+ * Creates a tag-only cache for every combination of the given sizes,
+ * associativities, block sizes and policies. Combinations that can't be
+ * built (more ways than lines, a policy that can't handle the geometry)
+ * are reported on stderr and left out. With "rate" below 1 only about that
+ * fraction of each cache's sets is simulated. Returns NULL if none are left.
+ */
+sweep* create_sweep(const int* sizes, int nsizes, const int* assocs, int nassocs,
+		const int* blocks, int nblocks, const int* policies, int npolicies, unsigned int seed, double rate) {
+	int max = nsizes * nassocs * nblocks * npolicies;
+	sweep* s = (sweep*) calloc(1, sizeof(sweep));
+	s->configs = (cache_config*) malloc(max * sizeof(cache_config));
+	s->caches = (cache**) malloc(max * sizeof(cache*));
+	s->next_use = (long**) calloc(max, sizeof(long*));
+
+	for (int a = 0; a < nsizes; a++)
+	for (int b = 0; b < nassocs; b++)
+	for (int k = 0; k < nblocks; k++)
+	for (int p = 0; p < npolicies; p++) {
+		cache_config cfg = {.size_kb = sizes[a], .assoc = assocs[b], .block_size = blocks[k],
+			.policy = policies[p], .seed = seed};
+		cache* c = NULL;
+		if ((long) cfg.assoc * cfg.block_size <= (long) cfg.size_kb * 1024) {
+			c = create_cache(&cfg, 0);
+		}
+		if (c == NULL) {
+			fprintf(stderr, "sweep: skipping %dkB, %d-way, %dB blocks, %s\n",
+				cfg.size_kb, cfg.assoc, cfg.block_size, repl_policy_name(cfg.policy));
+			continue;
+		}
+		s->configs[s->count] = cfg;
+		s->caches[s->count] = c;
+		s->count++;
+	}
+
+	if (s->count == 0) {
+		destroy_sweep(s);
+		return NULL;
+	}
+
+	s->rate = (rate < 1.0) ? rate : 1.0;
+	if (s->rate < 1.0) {
+		unsigned long long threshold = sample_threshold(s->rate);
+		s->samples = (sweep_sample*) calloc(s->count, sizeof(sweep_sample));
+		for (int i = 0; i < s->count; i++) {
+			sweep_sample* smp = &s->samples[i];
+			int nsets = 1 << s->caches[i]->ibits;
+			smp->set_unit = (signed char*) malloc(nsets);
+			for (int set = 0; set < nsets; set++) {
+				unsigned long long h = sample_hash(set);
+				smp->set_unit[set] = sample_selected(h, threshold) ? sample_unit(h) : -1;
+				smp->sampled_sets += (smp->set_unit[set] >= 0);
+			}
+			// Too few sets to sample: simulate them all
+			if (smp->sampled_sets == 0) {
+				for (int set = 0; set < nsets; set++) {
+					smp->set_unit[set] = sample_unit(sample_hash(set));
+				}
+				smp->sampled_sets = nsets;
+			}
+		}
+	}
+	return s;
+}
+
+void destroy_sweep(sweep* s) {
+	if (s == NULL) {
+		return;
+	}
+	for (int i = 0; i < s->count; i++) {
+		destroy_cache(s->caches[i]);
+		free(s->next_use[i]);
+		if (s->samples != NULL) {
+			free(s->samples[i].set_unit);
+		}
+	}
+	free(s->samples);
+	free(s->configs);
+	free(s->caches);
+	free(s->next_use);
+	free(s);
+}
+
+/**
+ * Gives every OPT cache its view of the future. The block trace is built
+ * once per distinct block size, by scanning the trace, and the result
+ * shared between caches using it. A sampled cache only sees accesses to
+ * its sampled sets, so its future is built from those alone and shared
+ * only with the same set mapping.
+ */
+static void prepare_opt(sweep* s, trace_reader* trace, const page_table* pt) {
+	for (int i = 0; i < s->count; i++) {
+		cache* c = s->caches[i];
+		if (s->configs[i].policy != REPL_OPT) {
+			continue;
+		}
+		long* nextUse = NULL;
+		long numBlocks = 0;
+		for (int j = 0; j < i && nextUse == NULL; j++) {
+			if (s->next_use[j] != NULL && s->caches[j]->bbits == c->bbits
+					&& (s->samples == NULL || s->caches[j]->ibits == c->ibits)) {
+				nextUse = s->next_use[j];
+				numBlocks = s->caches[j]->repl->num_accesses;
+			}
+		}
+		if (nextUse == NULL) {
+			long* blocks = scan_block_trace(trace, pt, c->bbits, &numBlocks);
+			if (s->samples != NULL) {
+				long kept = 0;
+				for (long k = 0; k < numBlocks; k++) {
+					if (s->samples[i].set_unit[blocks[k] & ((1 << c->ibits) - 1)] >= 0) {
+						blocks[kept++] = blocks[k];
+					}
+				}
+				numBlocks = kept;
+			}
+			nextUse = compute_next_use(blocks, numBlocks);
+			free(blocks);
+			s->next_use[i] = nextUse;
+		}
+		repl_set_future(c->repl, nextUse, numBlocks);
+	}
+}
+
+/**
+ * Reads and translates the next accesses of the trace into "buf", up to
+ * "cap" of them, counting page faults and malformed records on the way.
+ * Returns the number decoded, 0 at the end of the trace.
+ */
+static long decode_chunk(sweep* s, trace_reader* trace, const page_table* pt, tlb* t,
+		sweep_access* buf, long cap) {
+	long n = 0;
+	const trace_record* rec;
+	int status;
+	while (n < cap && (status = next_record(trace, &rec)) != 0) {
+		if (status < 0) {
+			s->malformed++;
+			continue;
+		}
+		int pa = (t != NULL) ? tlb_translate(t, pt, trace_vaddr(rec))
+			: translate_address(pt, trace_vaddr(rec));
+		if (pa == PAGEFAULT_ADDR) {
+			s->page_faults++;
+			continue;
+		}
+		buf[n].address = pa;
+		buf[n].size = rec->size;
+		buf[n].is_store = (rec->op == TRACE_STORE);
+		n++;
+	}
+	return n;
+}
+
+// Feeds one access to configuration "i". A sampled configuration sees it
+// block by block, skipping blocks in sets left out of its sample.
+static void sweep_access_one(sweep* s, int i, int address, int size, int is_store) {
+	cache* c = s->caches[i];
+	if (s->samples == NULL) {
+		cache_access(c, address, size, is_store);
+		return;
+	}
+	sweep_sample* smp = &s->samples[i];
+	unsigned int end = (unsigned int) address + size;
+	unsigned int part = (unsigned int) address;
+	do {
+		unsigned int next = ((part >> c->bbits) + 1) << c->bbits;
+		int len = (int) ((next < end ? next : end) - part);
+		int unit = smp->set_unit[(part >> c->bbits) & ((1 << c->ibits) - 1)];
+		smp->blocks++;
+		if (unit >= 0) {
+			int hit = cache_access(c, (int) part, len, is_store);
+			smp->accesses[unit]++;
+			smp->misses[unit] += !hit;
+		}
+		part = next;
+	} while (part < end);
+}
+
+// A worker's tasks (configuration indices). The owner takes from the
+// tail, thieves from the head.
+typedef struct task_deque {
+	pthread_mutex_t lock;
+	int* tasks;
+	int head;
+	int tail;
+} task_deque;
+
+typedef struct sweep_pool {
+	sweep* s;
+	const sweep_access* accesses;
+	long count;
+	int nthreads;
+	task_deque* deques;   // [nthreads]
+} sweep_pool;
+
+typedef struct sweep_worker {
+	sweep_pool* pool;
+	int id;
+	int started;
+	pthread_t thread;
+} sweep_worker;
+
+static int pop_task(task_deque* d) {
+	int task = -1;
+	pthread_mutex_lock(&d->lock);
+	if (d->head < d->tail) {
+		task = d->tasks[--d->tail];
+	}
+	pthread_mutex_unlock(&d->lock);
+	return task;
+}
+
+static int steal_task(task_deque* d) {
+	int task = -1;
+	pthread_mutex_lock(&d->lock);
+	if (d->head < d->tail) {
+		task = d->tasks[d->head++];
+	}
+	pthread_mutex_unlock(&d->lock);
+	return task;
+}
+
+static void run_config(sweep_pool* pool, int task) {
+	const sweep_access* a = pool->accesses;
+	if (pool->s->samples == NULL) {
+		cache* c = pool->s->caches[task];
+		for (long k = 0; k < pool->count; k++) {
+			cache_access(c, a[k].address, a[k].size, a[k].is_store);
+		}
+		return;
+	}
+	for (long k = 0; k < pool->count; k++) {
+		sweep_access_one(pool->s, task, a[k].address, a[k].size, a[k].is_store);
+	}
+}
+
+// No task creates new ones, so once every deque is empty the sweep is done
+static void* sweep_worker_main(void* arg) {
+	sweep_worker* w = (sweep_worker*) arg;
+	sweep_pool* pool = w->pool;
+	for (;;) {
+		int task = pop_task(&pool->deques[w->id]);
+		for (int k = 1; task < 0 && k < pool->nthreads; k++) {
+			task = steal_task(&pool->deques[(w->id + k) % pool->nthreads]);
+		}
+		if (task < 0) {
+			return NULL;
+		}
+		run_config(pool, task);
+	}
+}
+
+static void run_parallel(sweep* s, const sweep_access* accesses, long count, int threads) {
+	if (threads > s->count) {
+		threads = s->count;
+	}
+	sweep_pool pool = {s, accesses, count, threads, NULL};
+	pool.deques = (task_deque*) malloc(threads * sizeof(task_deque));
+	for (int i = 0; i < threads; i++) {
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+		pool.deques[i].tasks = (int*) malloc(s->count * sizeof(int));
+		pool.deques[i].head = 0;
+		pool.deques[i].tail = 0;
+	}
+	// Deal the configurations out round robin
+	for (int i = 0; i < s->count; i++) {
+		task_deque* d = &pool.deques[i % threads];
+		d->tasks[d->tail++] = i;
+	}
+
+	sweep_worker* workers = (sweep_worker*) malloc(threads * sizeof(sweep_worker));
+	for (int i = 0; i < threads; i++) {
+		workers[i].pool = &pool;
+		workers[i].id = i;
+		workers[i].started = (i > 0
+			&& pthread_create(&workers[i].thread, NULL, sweep_worker_main, &workers[i]) == 0);
+	}
+	// The calling thread works too, and picks up after any thread that
+	// couldn't be started
+	sweep_worker_main(&workers[0]);
+	for (int i = 1; i < threads; i++) {
+		if (workers[i].started) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+
+	for (int i = 0; i < threads; i++) {
+		pthread_mutex_destroy(&pool.deques[i].lock);
+		free(pool.deques[i].tasks);
+	}
+	free(pool.deques);
+	free(workers);
+}
+
+/**
+ * Runs the whole trace through every cache in the sweep. Addresses are
+ * translated once per record, through "t" if it isn't NULL. One thread
+ * streams the trace past all caches; more decode it SWEEP_CHUNK accesses
+ * at a time and share each chunk, or stream too if there's no memory for
+ * a chunk.
+ */
+void run_sweep(sweep* s, trace_reader* trace, const page_table* pt, tlb* t, int threads) {
+	prepare_opt(s, trace, pt);
+	sweep_access* chunk = NULL;
+	if (threads > 1 && s->count > 1) {
+		chunk = (sweep_access*) malloc(SWEEP_CHUNK * sizeof(sweep_access));
+	}
+	if (chunk != NULL) {
+		long n;
+		while ((n = decode_chunk(s, trace, pt, t, chunk, SWEEP_CHUNK)) > 0) {
+			run_parallel(s, chunk, n, threads);
+			s->accesses += n;
+		}
+		free(chunk);
+		return;
+	}
+
+	const trace_record* rec;
+	int status;
+	while ((status = next_record(trace, &rec)) != 0) {
+		if (status < 0) {
+			s->malformed++;
+			continue;
+		}
+		int pa = (t != NULL) ? tlb_translate(t, pt, trace_vaddr(rec))
+			: translate_address(pt, trace_vaddr(rec));
+		if (pa == PAGEFAULT_ADDR) {
+			s->page_faults++;
+			continue;
+		}
+		int is_store = (rec->op == TRACE_STORE);
+		for (int i = 0; i < s->count; i++) {
+			sweep_access_one(s, i, pa, rec->size, is_store);
+		}
+		s->accesses++;
+	}
+}
+
+/**
+ * Prints one row per configuration, as CSV with a header line or as a
+ * JSON document. A row's accesses are block accesses, a record spanning
+ * two blocks counting twice. Sampled sweeps scale hits, misses and
+ * writebacks up to the whole trace and add the number of sets simulated
+ * and the standard error of the hit rate, in percentage points.
+ */
+void print_sweep(const sweep* s, int json) {
+	int sampled = (s->samples != NULL);
+	if (json) {
+		printf("{\"accesses\": %ld, \"page_faults\": %ld, ", s->accesses, s->page_faults);
+		if (sampled) {
+			printf("\"sample_rate\": %g, ", s->rate);
+		}
+		printf("\"configs\": [\n");
+	}
+	else {
+		printf("size_kb,assoc,block_size,policy,accesses,hits,misses,hit_rate,writebacks%s\n",
+			sampled ? ",sampled_sets,hit_rate_error" : "");
+	}
+	for (int i = 0; i < s->count; i++) {
+		const cache_config* cfg = &s->configs[i];
+		const cache* c = s->caches[i];
+		long accesses = c->hits + c->misses;
+		long hits = c->hits, misses = c->misses, writebacks = c->writebacks;
+		double error = 0.0;
+		if (sampled && accesses > 0) {
+			const sweep_sample* smp = &s->samples[i];
+			double scale = (double) smp->blocks / accesses;
+			double fraction = (double) smp->sampled_sets / (1 << c->ibits);
+			hits = (long) (c->hits * scale + 0.5);
+			misses = smp->blocks - hits;
+			writebacks = (long) (c->writebacks * scale + 0.5);
+			accesses = smp->blocks;
+			error = 100.0 * sample_error(smp->accesses, smp->misses, fraction);
+		}
+		double hit_rate = accesses ? 100.0 * hits / accesses : 0.0;
+		if (json) {
+			printf("  {\"size_kb\": %d, \"assoc\": %d, \"block_size\": %d, \"policy\": \"%s\", "
+				"\"accesses\": %ld, \"hits\": %ld, \"misses\": %ld, \"hit_rate\": %.2f, "
+				"\"writebacks\": %ld",
+				cfg->size_kb, cfg->assoc, cfg->block_size, repl_policy_name(cfg->policy),
+				accesses, hits, misses, hit_rate, writebacks);
+			if (sampled) {
+				printf(", \"sampled_sets\": %d, \"hit_rate_error\": %.2f",
+					s->samples[i].sampled_sets, error);
+			}
+			printf("}%s\n", (i + 1 < s->count) ? "," : "");
+		}
+		else {
+			printf("%d,%d,%d,%s,%ld,%ld,%ld,%.2f,%ld",
+				cfg->size_kb, cfg->assoc, cfg->block_size, repl_policy_name(cfg->policy),
+				accesses, hits, misses, hit_rate, writebacks);
+			if (sampled) {
+				printf(",%d,%.2f", s->samples[i].sampled_sets, error);
+			}
+			printf("\n");
+		}
+	}
+	if (json) {
+		printf("]}\n");
+	}
+}
+// ============================================================================
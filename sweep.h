@@ -0,0 +1,56 @@
+/**
+ * sweep.h - Multi-configuration sweep for cachesimplus
+ * Runs every cache geometry in a list side by side over a single pass of
+ * the trace and reports one row of totals per configuration
+ **/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "cache.h"
+#include "pagetable.h"
+#include "tlb.h"
+#include "trace.h"
+#include "sample.h"
+
+#define SWEEP_MAX_VALUES 64
+
+// One decoded access in the shared trace buffer of a parallel sweep
+typedef struct sweep_access {
+	int address;          // physical
+	int size;
+	int is_store;
+} sweep_access;
+
+// Set sampling state of one configuration
+typedef struct sweep_sample {
+	signed char* set_unit;     // [nsets], the set's sample unit, -1 if not simulated
+	int sampled_sets;
+	long blocks;               // block accesses over all sets, simulated or not
+	long accesses[SAMPLE_UNITS];
+	long misses[SAMPLE_UNITS];
+} sweep_sample;
+
+typedef struct sweep {
+	int count;
+	cache_config* configs; // [count]
+	cache** caches;        // [count], tag-only
+	long** next_use;       // [count], OPT futures, shared between equal block sizes
+	double rate;           // fraction of sets simulated, 1 for all of them
+	sweep_sample* samples; // [count], NULL unless rate < 1
+	long accesses;         // accesses that reached the caches
+	long page_faults;
+	long malformed;
+} sweep;
+
+// Signatures =================================================================
+int parse_value_list(const char* spec, int* values, int max);
+int parse_policy_list(const char* spec, int* policies, int max);
+sweep* create_sweep(const int* sizes, int nsizes, const int* assocs, int nassocs,
+	const int* blocks, int nblocks, const int* policies, int npolicies, unsigned int seed, double rate);
+void destroy_sweep(sweep* s);
+void run_sweep(sweep* s, trace_reader* trace, const page_table* pt, tlb* t, int threads);
+void print_sweep(const sweep* s, int json);
+// ============================================================================
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * timing.c - Cycle-approximate timing for cachesimplus
+ * An in-order core issuing one access a cycle to non-blocking caches,
+ * with a finite set of MSHRs tracking the misses in flight
+ *
+ * The cache engine decides hits and misses as before; this layer only
+ * says when each access completes. A hit completes after the hit latency
+ * without waiting for earlier misses (hit under miss). A miss takes an
+ * MSHR for its block until the block arrives, so up to "nmshrs" misses
+ * overlap. A later access to a block still in flight merges into its MSHR
+ * and completes when the block does, even if the tags already say hit. A
+ * miss finding every MSHR busy stalls issue until the first one frees.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "timing.h"
+
+// Definitions ================================================================
+/**
+ * Creates a core with "nmshrs" MSHRs, at cycle 0.
+ * Returns NULL if "nmshrs" is out of range.
+ */
+timing* create_timing(int nmshrs) {
+	if (nmshrs < 1 || nmshrs > TIMING_MAX_MSHRS) {
+		return NULL;
+	}
+	timing* t = (timing*) calloc(1, sizeof(timing));
+	t->nmshrs = nmshrs;
+	for (int i = 0; i < nmshrs; i++) {
+		t->mshrs[i].block = TIMING_NO_BLOCK;
+	}
+	return t;
+}
+
+void destroy_timing(timing* t) {
+	free(t);
+}
+
+// Frees the MSHRs whose blocks have arrived by "cycle"; returns how many are still busy
+static int retire(timing* t, long cycle) {
+	int busy = 0;
+	for (int i = 0; i < t->nmshrs; i++) {
+		if (t->mshrs[i].block != TIMING_NO_BLOCK && t->mshrs[i].ready <= cycle) {
+			t->mshrs[i].block = TIMING_NO_BLOCK;
+		}
+		busy += (t->mshrs[i].block != TIMING_NO_BLOCK);
+	}
+	return busy;
+}
+
+/**
+ * Issues the next access, to "block". "miss_latency" is the cycles to
+ * bring the block from wherever it was found below the first level, or 0
+ * if it hit there; "hit_latency" is the first level's.
+ * Returns the access's latency, stalls included.
+ */
+long timing_access(timing* t, unsigned int block, int miss_latency, int hit_latency) {
+	long issue = t->cycle;
+	int busy = retire(t, issue);
+	long done = issue + hit_latency;
+	int free_slot = -1;
+	int in_flight = 0;
+	for (int i = 0; i < t->nmshrs; i++) {
+		if (t->mshrs[i].block == block) {
+			done = (t->mshrs[i].ready > done) ? t->mshrs[i].ready : done;
+			in_flight = 1;
+		}
+		else if (t->mshrs[i].block == TIMING_NO_BLOCK && free_slot < 0) {
+			free_slot = i;
+		}
+	}
+
+	if (in_flight) {
+		t->misses++;
+		t->merged++;
+	}
+	else if (miss_latency > 0) {
+		t->misses++;
+		if (free_slot < 0) {
+			// the core can't issue until the oldest miss comes back
+			long first = t->mshrs[0].ready;
+			free_slot = 0;
+			for (int i = 1; i < t->nmshrs; i++) {
+				if (t->mshrs[i].ready < first) {
+					first = t->mshrs[i].ready;
+					free_slot = i;
+				}
+			}
+			t->full_stalls++;
+			t->stall_cycles += first - issue;
+			t->cycle = first;
+			busy = retire(t, first);
+		}
+		t->mshrs[free_slot].block = block;
+		t->mshrs[free_slot].ready = t->cycle + hit_latency + miss_latency;
+		t->busy_cycles += hit_latency + miss_latency;
+		done = t->mshrs[free_slot].ready;
+		if (busy + 1 > t->peak) {
+			t->peak = busy + 1;
+		}
+	}
+
+	t->cycle++;
+	t->accesses++;
+	t->total_latency += done - issue;
+	if (done > t->finish) {
+		t->finish = done;
+	}
+	return done - issue;
+}
+
+// Cycles from the first issue until the last access completes
+long timing_cycles(const timing* t) {
+	return (t->finish > t->cycle) ? t->finish : t->cycle;
+}
+
+void print_timing_stats(const timing* t) {
+	long cycles = timing_cycles(t);
+	printf("Cycles: %ld accesses: %ld accesses per cycle: %.3f\n", cycles, t->accesses,
+		cycles ? (double) t->accesses / cycles : 0.0);
+	printf("AMAT: %.2f cycles (measured, stalls included)\n",
+		t->accesses ? (double) t->total_latency / t->accesses : 0.0);
+	printf("MSHRs: %d, average occupancy: %.2f peak: %d misses: %ld merged: %ld\n", t->nmshrs,
+		cycles ? (double) t->busy_cycles / cycles : 0.0, t->peak, t->misses, t->merged);
+	printf("MSHR full stalls: %ld (%ld cycles)\n", t->full_stalls, t->stall_cycles);
+}
+// ============================================================================
@@ -0,0 +1,42 @@
+/**
+ * timing.h - Cycle-approximate timing for cachesimplus
+ * An in-order core issuing one access a cycle to non-blocking caches,
+ * with a finite set of MSHRs tracking the misses in flight
+ **/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#define TIMING_MAX_MSHRS 64
+#define TIMING_NO_BLOCK 0xffffffffu
+
+// One miss status holding register: a block on its way from below
+typedef struct mshr {
+	unsigned int block;   // TIMING_NO_BLOCK when free
+	long ready;           // cycle the block arrives
+} mshr;
+
+typedef struct timing {
+	int nmshrs;
+	mshr mshrs[TIMING_MAX_MSHRS];
+	long cycle;           // issue cycle of the next access
+	long finish;          // latest completion so far
+	long accesses;
+	long total_latency;   // issue to completion, summed over accesses
+	long misses;          // accesses that needed a block from below
+	long merged;          // of those, ones that joined a miss already in flight
+	long full_stalls;     // times a miss waited for a free MSHR
+	long stall_cycles;    // cycles spent waiting
+	long busy_cycles;     // MSHR lifetimes summed, for the average occupancy
+	int peak;             // most MSHRs in use at once
+} timing;
+
+// Signatures =================================================================
+timing* create_timing(int nmshrs);
+void destroy_timing(timing* t);
+long timing_access(timing* t, unsigned int block, int miss_latency, int hit_latency);
+long timing_cycles(const timing* t);
+void print_timing_stats(const timing* t);
+// ============================================================================
+
+#endif
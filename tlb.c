@@ -0,0 +1,175 @@
+/**
+ * tlb.c - Set-associative TLB model in front of the page table
+ * Caches VPN -> PPN translations, 4kB and 2MB, and counts hits, misses
+ * and page faults
+ *
+ * 4kB and 2MB entries share the sets. A 2MB entry sits in the set its
+ * 2MB page number picks, so a lookup probes the 4kB set and, if the page
+ * table has any huge pages, the 2MB set too. Misses on a radix table are
+ * walked by "walker" when there is one.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "tlb.h"
+
+// Definitions ================================================================
+// Returns TLB_LRU or TLB_RANDOM for "name", or -1 if it names neither
+int parse_tlb_policy(const char* name) {
+	if (strcmp(name, "lru") == 0) return TLB_LRU;
+	if (strcmp(name, "random") == 0) return TLB_RANDOM;
+	return -1;
+}
+
+/**
+ * Creates an empty TLB with "entries" entries split into sets of "ways".
+ * Returns NULL if the geometry doesn't divide evenly.
+ */
+tlb* create_tlb(int entries, int ways, int policy) {
+	if (entries < 1 || ways < 1 || ways > entries || entries % ways != 0) {
+		return NULL;
+	}
+
+	tlb* t = (tlb*) malloc(sizeof(tlb));
+	t->entries = entries;
+	t->ways = ways;
+	t->nsets = entries / ways;
+	t->policy = policy;
+	t->vpn = (unsigned long long*) calloc(entries, sizeof(unsigned long long));
+	t->ppn = (int*) calloc(entries, sizeof(int));
+	t->valid = (unsigned char*) calloc(entries, sizeof(unsigned char));
+	t->huge = (unsigned char*) calloc(entries, sizeof(unsigned char));
+	t->last_use = (unsigned long*) calloc(entries, sizeof(unsigned long));
+	t->tick = 0;
+	t->seed = 2463534242u;
+	t->hits = 0;
+	t->misses = 0;
+	t->page_faults = 0;
+	t->huge_hits = 0;
+	t->walker = NULL;
+	return t;
+}
+
+void destroy_tlb(tlb* t) {
+	if (t == NULL) {
+		return;
+	}
+	free(t->vpn);
+	free(t->ppn);
+	free(t->valid);
+	free(t->huge);
+	free(t->last_use);
+	destroy_walker(t->walker);
+	free(t);
+}
+
+// xorshift32, so random replacement is reproducible run to run
+static unsigned int next_random(tlb* t) {
+	unsigned int x = t->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	t->seed = x;
+	return x;
+}
+
+/**
+ * Translates "va" through the TLB. Hits never touch the page table; misses
+ * walk "pt" and fill the TLB unless the page is invalid.
+ * Returns PAGEFAULT_ADDR on a page fault.
+ */
+int tlb_translate(tlb* t, const page_table* pt, unsigned long long va) {
+	unsigned long long vpn = va >> pt->offset_bits;
+	int offset = (int) (va & ((1u << pt->offset_bits) - 1));
+	int base = (int) (vpn % t->nsets) * t->ways;
+
+	t->tick++;
+	for (int w = base; w < base + t->ways; w++) {
+		if (t->valid[w] && !t->huge[w] && t->vpn[w] == vpn) {
+			t->hits++;
+			t->last_use[w] = t->tick;
+			return (t->ppn[w] << pt->offset_bits) | offset;
+		}
+	}
+	unsigned long long huge_vpn = va >> RADIX_HUGE_BITS;
+	if (pt->huge_pages > 0) {
+		int huge_base = (int) (huge_vpn % t->nsets) * t->ways;
+		for (int w = huge_base; w < huge_base + t->ways; w++) {
+			if (t->valid[w] && t->huge[w] && t->vpn[w] == huge_vpn) {
+				t->hits++;
+				t->huge_hits++;
+				t->last_use[w] = t->tick;
+				return (t->ppn[w] << RADIX_PAGE_BITS) | (int) (va & ((1u << RADIX_HUGE_BITS) - 1));
+			}
+		}
+	}
+
+	t->misses++;
+	page_walk walk;
+	walk.huge = 0;
+	int pa;
+	if (t->walker != NULL) {
+		pa = walk_translate(t->walker, pt, va);
+		walk.huge = t->walker->last.huge;
+	}
+	else if (pt->levels > 0) {
+		pa = walk_page_table(pt, va, 0, 0, &walk);
+	}
+	else {
+		pa = translate_address(pt, va);
+	}
+	if (pa == PAGEFAULT_ADDR) {
+		t->page_faults++;
+		return PAGEFAULT_ADDR;
+	}
+	if (walk.huge) {
+		vpn = huge_vpn;
+		base = (int) (vpn % t->nsets) * t->ways;
+	}
+
+	// Fill an invalid way first, otherwise evict per policy
+	int victim = -1;
+	for (int w = base; w < base + t->ways; w++) {
+		if (!t->valid[w]) {
+			victim = w;
+			break;
+		}
+	}
+	if (victim < 0) {
+		if (t->policy == TLB_RANDOM) {
+			victim = base + next_random(t) % t->ways;
+		}
+		else {
+			victim = base;
+			for (int w = base + 1; w < base + t->ways; w++) {
+				if (t->last_use[w] < t->last_use[victim]) {
+					victim = w;
+				}
+			}
+		}
+	}
+
+	t->valid[victim] = 1;
+	t->huge[victim] = (unsigned char) walk.huge;
+	t->vpn[victim] = vpn;
+	t->ppn[victim] = walk.huge ? (pa >> RADIX_HUGE_BITS) << RADIX_LEVEL_BITS : pa >> pt->offset_bits;
+	t->last_use[victim] = t->tick;
+	return pa;
+}
+
+void print_tlb_stats(const tlb* t) {
+	long accesses = t->hits + t->misses;
+	double hit_rate = accesses ? 100.0 * t->hits / accesses : 0.0;
+	printf("TLB: %d entries, %d-way, %s\n", t->entries, t->ways,
+		t->policy == TLB_RANDOM ? "random" : "lru");
+	printf("TLB hits: %ld misses: %ld hit rate: %.2f%%\n", t->hits, t->misses, hit_rate);
+	if (t->huge_hits > 0) {
+		printf("TLB hits on 2MB pages: %ld\n", t->huge_hits);
+	}
+	printf("Page faults: %ld\n", t->page_faults);
+	if (t->walker != NULL) {
+		print_walker_stats(t->walker);
+	}
+}
+// ============================================================================
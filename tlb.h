@@ -0,0 +1,43 @@
+/**
+ * tlb.h - Set-associative TLB model in front of the page table
+ * Caches VPN -> PPN translations, 4kB and 2MB, and counts hits, misses
+ * and page faults
+ **/
+
+#ifndef TLB_H
+#define TLB_H
+
+#include "pagetable.h"
+#include "pagewalk.h"
+
+#define TLB_LRU 0
+#define TLB_RANDOM 1
+
+typedef struct tlb {
+	int entries;
+	int ways;
+	int nsets;
+	int policy;              // TLB_LRU or TLB_RANDOM
+	unsigned long long* vpn; // [nsets * ways], of a 2MB page for huge entries
+	int* ppn;                // [nsets * ways], in 4kB frames
+	unsigned char* valid;    // [nsets * ways]
+	unsigned char* huge;     // [nsets * ways], maps a 2MB page
+	unsigned long* last_use; // [nsets * ways], LRU timestamps
+	unsigned long tick;
+	unsigned int seed;
+	long hits;
+	long misses;
+	long page_faults;
+	long huge_hits;
+	page_walker* walker;     // radix tables: walks the misses, owned by the TLB
+} tlb;
+
+// Signatures =================================================================
+int parse_tlb_policy(const char* name);
+tlb* create_tlb(int entries, int ways, int policy);
+void destroy_tlb(tlb* t);
+int tlb_translate(tlb* t, const page_table* pt, unsigned long long va);
+void print_tlb_stats(const tlb* t);
+// ============================================================================
+
+#endif
@@ -0,0 +1,366 @@
+/**
+ * trace.c - Trace readers for cachesimplus
+ * Reads text traces ("load 0x1f 4" / "store 0x1f 4 deadbeef") and the
+ * binary format written by tracecvt, picking the format from the header
+ *
+ * Binary traces are mmap'd and handed out as pointers into the mapping,
+ * so no record is copied or parsed. Text traces are read a chunk at a time
+ * and parsed by hand with table-driven hex decoding.
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+// Hex digit values, 0xff for anything that isn't a hex digit
+static unsigned char hex_value[256];
+
+static void init_hex_table(void) {
+	if (hex_value[0] == 0xff) {
+		return;
+	}
+	memset(hex_value, 0xff, sizeof(hex_value));
+	for (int i = 0; i < 10; i++) {
+		hex_value['0' + i] = i;
+	}
+	for (int i = 0; i < 6; i++) {
+		hex_value['a' + i] = 10 + i;
+		hex_value['A' + i] = 10 + i;
+	}
+}
+
+// Definitions ================================================================
+static int open_binary(trace_reader* t) {
+	struct stat st;
+	if (fstat(fileno(t->file), &st) != 0 || st.st_size < TRACE_HEADER_SIZE) {
+		return 0;
+	}
+
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(t->file), 0);
+	if (map == MAP_FAILED) {
+		return 0;
+	}
+	t->map = (unsigned char*) map;
+	t->map_len = st.st_size;
+
+	unsigned long long count;
+	memcpy(&count, t->map + TRACE_MAGIC_LEN, sizeof(count));
+	long available = (long) ((st.st_size - TRACE_HEADER_SIZE) / sizeof(trace_record));
+	t->count = (count < (unsigned long long) available) ? (long) count : available;
+	t->records = (const trace_record*) (t->map + TRACE_HEADER_SIZE);
+	t->binary = 1;
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+	return 1;
+}
+
+/**
+ * Opens a text or binary trace. Returns NULL if the file can't be read.
+ */
+trace_reader* open_trace(const char* fileName) {
+	FILE* f = fopen(fileName, "r");
+	if (f == NULL) {
+		return NULL;
+	}
+
+	trace_reader* t = (trace_reader*) calloc(1, sizeof(trace_reader));
+	t->file = f;
+
+	char magic[TRACE_MAGIC_LEN];
+	if (fread(magic, 1, TRACE_MAGIC_LEN, f) == TRACE_MAGIC_LEN
+			&& memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+		if (!open_binary(t)) {
+			close_trace(t);
+			return NULL;
+		}
+	}
+	else {
+		init_hex_table();
+		t->buf = (char*) malloc(TRACE_CHUNK);
+	}
+	rewind(f);
+	return t;
+}
+
+void close_trace(trace_reader* t) {
+	if (t == NULL) {
+		return;
+	}
+	if (t->map != NULL) {
+		munmap(t->map, t->map_len);
+	}
+	fclose(t->file);
+	free(t->buf);
+	free(t);
+}
+
+/**
+ * Finds the next line in the chunk buffer, refilling it as needed. Sets
+ * "start"/"end" to the line without its newline. Returns 0 at end of file
+ * and -1 (after skipping it) if a line doesn't fit in the buffer.
+ */
+static int next_line(trace_reader* t, const char** start, const char** end) {
+	for (;;) {
+		char* line = t->buf + t->buf_pos;
+		char* nl = memchr(line, '\n', t->buf_len - t->buf_pos);
+		if (nl != NULL) {
+			*start = line;
+			*end = nl;
+			t->buf_pos = nl + 1 - t->buf;
+			return 1;
+		}
+		if (t->eof) {
+			// last line without a trailing newline
+			if (t->buf_pos == t->buf_len) {
+				return 0;
+			}
+			*start = line;
+			*end = t->buf + t->buf_len;
+			t->buf_pos = t->buf_len;
+			return 1;
+		}
+
+		size_t rest = t->buf_len - t->buf_pos;
+		if (rest == TRACE_CHUNK) {
+			// Line too long: drop it up to its newline and report it
+			do {
+				t->buf_len = fread(t->buf, 1, TRACE_CHUNK, t->file);
+				if (t->buf_len < TRACE_CHUNK) {
+					t->eof = 1;
+				}
+				nl = memchr(t->buf, '\n', t->buf_len);
+			} while (nl == NULL && !t->eof);
+			t->buf_pos = (nl != NULL) ? (size_t) (nl + 1 - t->buf) : t->buf_len;
+			return -1;
+		}
+		memmove(t->buf, line, rest);
+		t->buf_len = rest + fread(t->buf + rest, 1, TRACE_CHUNK - rest, t->file);
+		t->buf_pos = 0;
+		if (t->buf_len < TRACE_CHUNK) {
+			t->eof = 1;
+		}
+	}
+}
+
+static int is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * Parses one "load <hex addr> <size>" or "store <hex addr> <size> <hex data>"
+ * line into t->current. Any number of blanks may separate the fields.
+ */
+static int parse_text_line(trace_reader* t, const char* p, const char* end) {
+	trace_record* r = &t->current;
+	memset(r, 0, sizeof(trace_record));
+
+	if (end - p >= 4 && memcmp(p, "load", 4) == 0) {
+		r->op = TRACE_LOAD;
+		p += 4;
+	}
+	else if (end - p >= 5 && memcmp(p, "store", 5) == 0) {
+		r->op = TRACE_STORE;
+		p += 5;
+	}
+	else {
+		return -1;
+	}
+	if (p == end || !is_blank(*p)) return -1;
+	while (p < end && is_blank(*p)) p++;
+
+	// address, optional 0x prefix, at most 12 hex digits (48 bits)
+	if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		p += 2;
+	}
+	unsigned long long address = 0;
+	int digits = 0;
+	while (p < end && hex_value[(unsigned char) *p] != 0xff) {
+		address = (address << 4) | hex_value[(unsigned char) *p];
+		p++;
+		digits++;
+	}
+	if (digits == 0 || digits > 12 || p == end || !is_blank(*p)) return -1;
+	r->address = (unsigned int) address;
+	r->address_hi = (unsigned short) (address >> 32);
+	while (p < end && is_blank(*p)) p++;
+
+	// access size in decimal
+	int size = 0;
+	digits = 0;
+	while (p < end && *p >= '0' && *p <= '9' && size <= 255) {
+		size = size * 10 + (*p - '0');
+		p++;
+		digits++;
+	}
+	if (digits == 0 || size < 1 || size > 255) return -1;
+	r->size = (unsigned char) size;
+
+	if (r->op == TRACE_STORE) {
+		if (size > TRACE_MAX_DATA || p == end || !is_blank(*p)) return -1;
+		while (p < end && is_blank(*p)) p++;
+		// exactly two hex digits per byte stored
+		if (end - p < 2 * size) return -1;
+		for (int i = 0; i < size; i++) {
+			unsigned char hi = hex_value[(unsigned char) p[0]];
+			unsigned char lo = hex_value[(unsigned char) p[1]];
+			if ((hi | lo) == 0xff) return -1;
+			r->data[i] = (hi << 4) | lo;
+			p += 2;
+		}
+	}
+
+	while (p < end && is_blank(*p)) p++;
+	return (p == end) ? 1 : -1;
+}
+
+static int next_text_record(trace_reader* t, const trace_record** rec) {
+	const char* start;
+	const char* end;
+	for (;;) {
+		int status = next_line(t, &start, &end);
+		if (status <= 0) {
+			if (status < 0) t->line++;
+			return status;
+		}
+		t->line++;
+
+		// skip blank lines
+		const char* p = start;
+		while (p < end && is_blank(*p)) p++;
+		if (p == end) {
+			continue;
+		}
+
+		if (parse_text_line(t, p, end) < 0) {
+			return -1;
+		}
+		*rec = &t->current;
+		return 1;
+	}
+}
+
+// The checks parse_text_line() makes, for records read as they are
+static int valid_record(const trace_record* r) {
+	return (r->op == TRACE_LOAD || r->op == TRACE_STORE) && r->size >= 1
+		&& (r->op == TRACE_LOAD || r->size <= TRACE_MAX_DATA);
+}
+
+/**
+ * Points "rec" at the next record. Returns 1 on success, 0 at the end of
+ * the trace and -1 on a malformed record, with t->line holding its line
+ * number (its record number in a binary trace); reading can carry on past
+ * it. The record stays valid until the next call.
+ */
+int next_record(trace_reader* t, const trace_record** rec) {
+	if (t->binary) {
+		if (t->pos >= t->count) {
+			return 0;
+		}
+		const trace_record* r = &t->records[t->pos++];
+		if (!valid_record(r)) {
+			t->line = t->pos;
+			return -1;
+		}
+		*rec = r;
+		return 1;
+	}
+	return next_text_record(t, rec);
+}
+
+void rewind_trace(trace_reader* t) {
+	if (t->binary) {
+		t->pos = 0;
+	}
+	else {
+		rewind(t->file);
+		t->line = 0;
+		t->buf_len = 0;
+		t->buf_pos = 0;
+		t->eof = 0;
+	}
+}
+
+/**
+ * Where the next record comes from: its index in a binary trace, its
+ * byte offset in a text one. For checkpoints, with seek_trace().
+ */
+long tell_trace(const trace_reader* t) {
+	if (t->binary) {
+		return t->pos;
+	}
+	return ftell(t->file) - (long) (t->buf_len - t->buf_pos);
+}
+
+/**
+ * Carries on reading from "offset", as returned by tell_trace(), with
+ * "line" lines already read. Returns 0, or -1 if "offset" is past the end.
+ */
+int seek_trace(trace_reader* t, long offset, long line) {
+	if (t->binary) {
+		if (offset < 0 || offset > t->count) {
+			return -1;
+		}
+		t->pos = offset;
+		return 0;
+	}
+	struct stat st;
+	if (offset < 0 || fstat(fileno(t->file), &st) != 0 || offset > st.st_size
+			|| fseek(t->file, offset, SEEK_SET) != 0) {
+		return -1;
+	}
+	t->line = line;
+	t->buf_len = 0;
+	t->buf_pos = 0;
+	t->eof = 0;
+	return 0;
+}
+
+/**
+ * Reads the whole trace once and returns the physical block address of
+ * every access that reaches the cache, in order, with an access crossing
+ * block boundaries listed once per block as the cache sees it. Used to
+ * give OPT its view of the future. Rewinds the trace when done.
+ */
+long* scan_block_trace(trace_reader* trace, const page_table* pt, int bbits, long* count) {
+	long cap = 1024, n = 0;
+	long* blocks = (long*) malloc(cap * sizeof(long));
+	const trace_record* rec;
+	int status;
+	while ((status = next_record(trace, &rec)) != 0) {
+		if (status < 0) {
+			continue;
+		}
+		int pa = translate_address(pt, trace_vaddr(rec));
+		if (pa == PAGEFAULT_ADDR) {
+			continue;
+		}
+		unsigned int first = (unsigned int) pa >> bbits;
+		unsigned int last = ((unsigned int) pa + rec->size - 1) >> bbits;
+		for (unsigned int b = first; ; b++) {
+			if (n == cap) {
+				cap *= 2;
+				blocks = (long*) realloc(blocks, cap * sizeof(long));
+			}
+			blocks[n++] = (long) b;
+			if (b == last) break;
+		}
+	}
+	rewind_trace(trace);
+	*count = n;
+	return blocks;
+}
+
+/**
+ * Writes the binary trace header announcing "count" records.
+ */
+int write_binary_header(FILE* out, unsigned long long count) {
+	unsigned char header[TRACE_HEADER_SIZE];
+	memcpy(header, TRACE_MAGIC, TRACE_MAGIC_LEN);
+	memcpy(header + TRACE_MAGIC_LEN, &count, sizeof(count));
+	return fwrite(header, 1, TRACE_HEADER_SIZE, out) == TRACE_HEADER_SIZE;
+}
+// ============================================================================
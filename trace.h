@@ -0,0 +1,67 @@
+/**
+ * trace.h - Trace readers for cachesimplus
+ * Reads text traces ("load 0x1f 4" / "store 0x1f 4 deadbeef") and the
+ * binary format written by tracecvt, picking the format from the header
+ **/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "pagetable.h"
+
+#define TRACE_LOAD 0
+#define TRACE_STORE 1
+#define TRACE_MAX_DATA 8
+
+// Binary trace: TRACE_MAGIC, a little-endian uint64 record count, then
+// that many trace_records exactly as laid out below (16 bytes each)
+#define TRACE_MAGIC "CSIMTRC1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_HEADER_SIZE 16
+
+// Text traces are read in chunks this big; no line may be longer
+#define TRACE_CHUNK (1 << 20)
+
+typedef struct trace_record {
+	unsigned char op;                   // TRACE_LOAD or TRACE_STORE
+	unsigned char size;                 // bytes accessed
+	unsigned short address_hi;          // virtual address bits 32-47, 0 in 32-bit traces
+	unsigned int address;               // virtual address bits 0-31
+	unsigned char data[TRACE_MAX_DATA]; // store payload, first "size" bytes
+} trace_record;
+
+typedef struct trace_reader {
+	int binary;
+	FILE* file;
+	trace_record current;        // text traces, the record just parsed
+	long line;                   // line of the current record, or a bad binary record's number
+	char* buf;                   // text traces, TRACE_CHUNK bytes read ahead
+	size_t buf_len;
+	size_t buf_pos;
+	int eof;
+	unsigned char* map;          // binary traces, the whole file mapped
+	size_t map_len;
+	const trace_record* records; // binary traces, points into map
+	long count;
+	long pos;
+} trace_reader;
+
+// The full virtual address of "r", up to 48 bits
+static inline unsigned long long trace_vaddr(const trace_record* r) {
+	return ((unsigned long long) r->address_hi << 32) | r->address;
+}
+
+// Signatures =================================================================
+trace_reader* open_trace(const char* fileName);
+void close_trace(trace_reader* t);
+int next_record(trace_reader* t, const trace_record** rec);
+void rewind_trace(trace_reader* t);
+long tell_trace(const trace_reader* t);
+int seek_trace(trace_reader* t, long offset, long line);
+int write_binary_header(FILE* out, unsigned long long count);
+long* scan_block_trace(trace_reader* trace, const page_table* pt, int bbits, long* count);
+// ============================================================================
+
+#endif
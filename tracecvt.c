@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+// Converts a text trace (traces/*.txt) to the binary trace format read by
+// cachesimplus. Usage: tracecvt <in.txt> <out.bin>
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        printf("%s: Wrong number of arguments, expecting 2\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    trace_reader* in = open_trace(argv[1]);
+    if (in == NULL) {
+        printf("%s: Could not read trace %s\n", argv[0], argv[1]);
+        return EXIT_FAILURE;
+    }
+    FILE* out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        printf("%s: Could not write %s\n", argv[0], argv[2]);
+        close_trace(in);
+        return EXIT_FAILURE;
+    }
+
+    // The record count is patched into the header once it's known. Only
+    // records next_record() accepts are written, so a malformed one (from
+    // a text trace or a damaged binary one) stops the conversion
+    write_binary_header(out, 0);
+    unsigned long long count = 0;
+    const trace_record* rec;
+    int status;
+    while ((status = next_record(in, &rec)) > 0) {
+        fwrite(rec, sizeof(trace_record), 1, out);
+        count++;
+    }
+    if (status < 0) {
+        printf("%s:%ld: malformed trace record\n", argv[1], in->line);
+        fclose(out);
+        close_trace(in);
+        remove(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    rewind(out);
+    write_binary_header(out, count);
+    fclose(out);
+    close_trace(in);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "trace.h"
+
+// Writes a synthetic trace for benchmarking cachesimplus.
+// Usage: tracegen <pattern> <count> <out> [footprint kB] [seed]
+//   seq     8-byte accesses walking the footprint in order
+//   stride  8-byte accesses 4kB + 64B apart, so each one is on a new page
+//           and in a new set
+//   zipf    8-byte accesses to 64-byte blocks picked with Zipf(0.99)
+//           popularity, the hot blocks scattered over the footprint
+//   chase   8-byte loads following a random cycle through every 64-byte
+//           block, as a linked list walk would
+//   random  1, 2, 4 or 8-byte accesses anywhere, like traces/random2.txt
+// All but chase are 60% loads. The count may be given as 1e6 etc. The
+// output is text if its name ends in .txt and binary otherwise. The
+// footprint starts at address 0 and defaults to 16MB, all of a 24-bit
+// page table.
+
+#define BLOCK 64
+#define ZIPF_S 0.99
+
+#define PAT_SEQ 0
+#define PAT_STRIDE 1
+#define PAT_ZIPF 2
+#define PAT_CHASE 3
+#define PAT_RANDOM 4
+
+static const char* patternNames[] = { "seq", "stride", "zipf", "chase", "random" };
+
+// xorshift64*, so a seed always gives the same trace
+static unsigned long long rngState;
+
+static unsigned long long next_random(void) {
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return rngState * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [0, 1)
+static double random_unit(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// A random order of 0..n-1; with "cycle" set, a single cycle through all
+// of them (Sattolo's algorithm) instead of any permutation
+static long* shuffled(long n, int cycle) {
+    long* p = (long*) malloc(n * sizeof(long));
+    for (long i = 0; i < n; i++) {
+        p[i] = i;
+    }
+    for (long i = n - 1; i > 0; i--) {
+        long j = (long) (next_random() % (unsigned long long) (cycle ? i : i + 1));
+        long t = p[i];
+        p[i] = p[j];
+        p[j] = t;
+    }
+    return p;
+}
+
+// Cumulative Zipf popularity of ranks 0..n-1
+static double* zipf_cdf(long n) {
+    double* cdf = (double*) malloc(n * sizeof(double));
+    double sum = 0.0;
+    for (long i = 0; i < n; i++) {
+        sum += 1.0 / pow((double) (i + 1), ZIPF_S);
+        cdf[i] = sum;
+    }
+    for (long i = 0; i < n; i++) {
+        cdf[i] /= sum;
+    }
+    return cdf;
+}
+
+// Rank drawn from "cdf" by binary search
+static long zipf_rank(const double* cdf, long n) {
+    double u = random_unit();
+    long lo = 0, hi = n - 1;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void write_record(FILE* out, int text, const trace_record* r) {
+    if (!text) {
+        fwrite(r, sizeof(trace_record), 1, out);
+        return;
+    }
+    fprintf(out, "%s 0x%x %d", r->op == TRACE_STORE ? "store" : "load", r->address, r->size);
+    if (r->op == TRACE_STORE) {
+        fputc(' ', out);
+        for (int i = 0; i < r->size; i++) {
+            fprintf(out, "%02x", r->data[i]);
+        }
+    }
+    fputc('\n', out);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4 || argc > 6) {
+        printf("%s: Wrong number of arguments, expecting 3 to 5\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int pattern = -1;
+    for (int i = 0; i <= PAT_RANDOM; i++) {
+        if (strcmp(argv[1], patternNames[i]) == 0) pattern = i;
+    }
+    if (pattern < 0) {
+        printf("%s: Unknown pattern %s\n", argv[0], argv[1]);
+        return EXIT_FAILURE;
+    }
+    unsigned long long count = (unsigned long long) atof(argv[2]);
+    long footprint = (argc > 4) ? atol(argv[4]) * 1024 : 16L * 1024 * 1024;
+    rngState = (argc > 5) ? strtoull(argv[5], NULL, 10) * 2654435761ULL + 1 : 88172645463325252ULL;
+    if (footprint < 1024) {
+        printf("%s: Footprint must be at least 1kB\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    long blocks = footprint / BLOCK;
+
+    long* order = NULL;
+    double* cdf = NULL;
+    if (pattern == PAT_ZIPF) {
+        order = shuffled(blocks, 0);
+        cdf = zipf_cdf(blocks);
+    }
+    else if (pattern == PAT_CHASE) {
+        order = shuffled(blocks, 1);
+    }
+
+    FILE* out = fopen(argv[3], "wb");
+    if (out == NULL) {
+        printf("%s: Could not write %s\n", argv[0], argv[3]);
+        return EXIT_FAILURE;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    size_t nameLen = strlen(argv[3]);
+    int text = nameLen >= 4 && strcmp(argv[3] + nameLen - 4, ".txt") == 0;
+    if (!text) {
+        write_binary_header(out, count);
+    }
+
+    long block = 0;
+    for (unsigned long long i = 0; i < count; i++) {
+        trace_record r;
+        memset(&r, 0, sizeof(r));
+        r.size = 8;
+        unsigned long long bits = next_random();
+        r.op = ((bits & 0xff) < 102) ? TRACE_STORE : TRACE_LOAD;
+        switch (pattern) {
+        case PAT_SEQ:
+            r.address = (unsigned int) ((i * 8) % footprint);
+            break;
+        case PAT_STRIDE:
+            r.address = (unsigned int) ((i * (4096 + BLOCK)) % footprint) & ~7u;
+            break;
+        case PAT_ZIPF:
+            r.address = (unsigned int) (order[zipf_rank(cdf, blocks)] * BLOCK + ((bits >> 8) & 7) * 8);
+            break;
+        case PAT_CHASE:
+            r.op = TRACE_LOAD;
+            block = order[block];
+            r.address = (unsigned int) (block * BLOCK);
+            break;
+        default:
+            r.size = (unsigned char) (1 << ((bits >> 8) & 3));
+            r.address = (unsigned int) ((bits >> 16) % (footprint - r.size + 1));
+        }
+        if (r.op == TRACE_STORE) {
+            unsigned long long data = next_random();
+            memcpy(r.data, &data, r.size);
+        }
+        write_record(out, text, &r);
+    }
+    if (fclose(out) != 0) {
+        printf("%s: Could not write %s\n", argv[0], argv[3]);
+        return EXIT_FAILURE;
+    }
+    free(order);
+    free(cdf);
+    return EXIT_SUCCESS;
+}
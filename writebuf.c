@@ -0,0 +1,135 @@
+/**
+ * writebuf.c - Coalescing write buffer in front of write_to_memory()
+ * Holds up to N block-sized entries with a byte mask each; stores to a
+ * block already in the buffer merge into its entry instead of going out
+ *
+ * Entries leave oldest first when a new block needs room, or all at once
+ * on write_buffer_drain(). Each run of waiting bytes is one memory write.
+ * Reads must see buffered data, so fills go through write_buffer_forward().
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include "writebuf.h"
+#include "memory.h"
+
+// Definitions ================================================================
+write_buffer* create_write_buffer(int entries, int block_size) {
+	if (entries < 1 || block_size < 1) {
+		return NULL;
+	}
+	write_buffer* wb = (write_buffer*) calloc(1, sizeof(write_buffer));
+	wb->entries = entries;
+	wb->block_size = block_size;
+	int n = block_size;
+	while (n >>= 1) wb->bbits++;
+	wb->block = (int*) malloc(entries * sizeof(int));
+	wb->data = (unsigned char*) malloc((size_t) entries * block_size);
+	wb->mask = (unsigned char*) calloc((size_t) entries * block_size, 1);
+	return wb;
+}
+
+void destroy_write_buffer(write_buffer* wb) {
+	if (wb == NULL) {
+		return;
+	}
+	free(wb->block);
+	free(wb->data);
+	free(wb->mask);
+	free(wb);
+}
+
+// Entry slot holding "block", or -1
+static int find_entry(const write_buffer* wb, int block) {
+	for (int i = 0; i < wb->count; i++) {
+		int slot = (wb->head + i) % wb->entries;
+		if (wb->block[slot] == block) {
+			return slot;
+		}
+	}
+	return -1;
+}
+
+// Writes out the oldest entry, one write per run of waiting bytes
+static void drain_oldest(write_buffer* wb) {
+	int slot = wb->head;
+	size_t base = (size_t) slot * wb->block_size;
+	int address = wb->block[slot] << wb->bbits;
+	int i = 0;
+	while (i < wb->block_size) {
+		if (!wb->mask[base + i]) {
+			i++;
+			continue;
+		}
+		int start = i;
+		while (i < wb->block_size && wb->mask[base + i]) i++;
+		write_to_memory(wb->data + base + start, address + start, i - start);
+		wb->bytes_out += i - start;
+		wb->drains++;
+	}
+	memset(wb->mask + base, 0, wb->block_size);
+	wb->head = (wb->head + 1) % wb->entries;
+	wb->count--;
+}
+
+/**
+ * Buffers "size" bytes from "val" for physical "address", merging them
+ * into the entry for their block if there is one. Writes crossing a block
+ * boundary are split between entries.
+ */
+void write_buffer_put(write_buffer* wb, int address, const unsigned char* val, int size) {
+	while (size > 0) {
+		int block = address >> wb->bbits;
+		int off = address & (wb->block_size - 1);
+		int n = wb->block_size - off;
+		if (n > size) n = size;
+
+		wb->writes++;
+		wb->bytes_in += n;
+		int slot = find_entry(wb, block);
+		if (slot >= 0) {
+			wb->coalesced++;
+		}
+		else {
+			if (wb->count == wb->entries) {
+				drain_oldest(wb);
+			}
+			slot = (wb->head + wb->count) % wb->entries;
+			wb->block[slot] = block;
+			wb->count++;
+		}
+		size_t base = (size_t) slot * wb->block_size + off;
+		memcpy(wb->data + base, val, n);
+		memset(wb->mask + base, 1, n);
+
+		address += n;
+		val += n;
+		size -= n;
+	}
+}
+
+/**
+ * Overlays any buffered bytes for [address, address + size) onto "buf",
+ * which was just read from memory.
+ */
+void write_buffer_forward(const write_buffer* wb, int address, unsigned char* buf, int size) {
+	for (int i = 0; i < wb->count; i++) {
+		int slot = (wb->head + i) % wb->entries;
+		int start = wb->block[slot] << wb->bbits;
+		int lo = (start > address) ? start : address;
+		int hi = (start + wb->block_size < address + size) ? start + wb->block_size : address + size;
+		size_t base = (size_t) slot * wb->block_size;
+		for (int a = lo; a < hi; a++) {
+			if (wb->mask[base + (a - start)]) {
+				buf[a - address] = wb->data[base + (a - start)];
+			}
+		}
+	}
+}
+
+void write_buffer_drain(write_buffer* wb) {
+	while (wb->count > 0) {
+		drain_oldest(wb);
+	}
+}
+// ============================================================================
@@ -0,0 +1,34 @@
+/**
+ * writebuf.h - Coalescing write buffer in front of write_to_memory()
+ * Holds up to N block-sized entries with a byte mask each; stores to a
+ * block already in the buffer merge into its entry instead of going out
+ **/
+
+#ifndef WRITEBUF_H
+#define WRITEBUF_H
+
+typedef struct write_buffer {
+	int entries;
+	int block_size;
+	int bbits;               // log2(block_size)
+	int count;               // entries in use, oldest at "head"
+	int head;
+	int* block;              // [entries], block address >> bbits
+	unsigned char* data;     // [entries * block_size]
+	unsigned char* mask;     // [entries * block_size], 1 for a byte waiting to go out
+	long writes;             // writes into the buffer
+	long coalesced;          // of those, merged into an existing entry
+	long bytes_in;
+	long bytes_out;          // bytes passed to write_to_memory()
+	long drains;             // calls to write_to_memory()
+} write_buffer;
+
+// Signatures =================================================================
+write_buffer* create_write_buffer(int entries, int block_size);
+void destroy_write_buffer(write_buffer* wb);
+void write_buffer_put(write_buffer* wb, int address, const unsigned char* val, int size);
+void write_buffer_forward(const write_buffer* wb, int address, unsigned char* buf, int size);
+void write_buffer_drain(write_buffer* wb);
+// ============================================================================
+
+#endif